@@ -0,0 +1,280 @@
+#include "simulator.hpp"
+#include "lockstep.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sys/stat.h>
+#include <vector>
+
+// pipeline-batch: many images in one process, one Simulator per task, or
+// one lockstep group per task for jobs sharing an instruction image
+
+namespace {
+    struct Job {
+        std::string name, iimage, dimage;
+        const char* result = "pending";
+        size_t cycles = 0;
+        double seconds = 0;
+    };
+
+    bool isFile(const std::string& path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+    }
+
+    bool isDir(const std::string& path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    bool makeDirs(const std::string& path) {
+        for (size_t i = 1; i <= path.size(); ++i) {
+            if (i == path.size() || path[i] == '/') {
+                const std::string part = path.substr(0, i);
+                if (mkdir(part.c_str(), 0755) != 0 && !isDir(part)) return false;
+            }
+        }
+        return true;
+    }
+
+    // every directory at or below dir holding iimage.bin and dimage.bin
+    void scan(const std::string& dir, const std::string& name, std::vector<Job>& jobs) {
+        if (isFile(dir + "/iimage.bin") && isFile(dir + "/dimage.bin")) {
+            Job job;
+            job.name = name;
+            job.iimage = dir + "/iimage.bin";
+            job.dimage = dir + "/dimage.bin";
+            jobs.push_back(job);
+        }
+        DIR* d = opendir(dir.c_str());
+        if (d == nullptr) return;
+        std::vector<std::string> subdirs;
+        while (dirent* e = readdir(d)) {
+            const std::string entry = e->d_name;
+            if (entry == "." || entry == "..") continue;
+            if (isDir(dir + "/" + entry)) subdirs.push_back(entry);
+        }
+        closedir(d);
+        std::sort(subdirs.begin(), subdirs.end());
+        for (const auto& sub : subdirs) {
+            scan(dir + "/" + sub, name + "_" + sub, jobs);
+        }
+    }
+
+    std::string baseName(std::string path) {
+        while (path.size() > 1 && path.back() == '/') path.pop_back();
+        const size_t slash = path.rfind('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    const char* statusName(const SimulatorBase::Status status) {
+        switch (status) {
+            case SimulatorBase::HALTED: return "halted";
+            case SimulatorBase::ERROR: return "error";
+            case SimulatorBase::ILLEGAL: return "illegal";
+            case SimulatorBase::LIMIT: return "limit";
+            case SimulatorBase::RUNNING: break;
+        }
+        return "running";
+    }
+
+    uint64_t isize = INSTR_SIZE, dsize = DATA_SIZE;
+
+    template <class Trace>
+    void runJob(Job& job, const std::string& outdir, const bool direct) {
+        const auto start = std::chrono::steady_clock::now();
+        const std::string dir = outdir + "/" + job.name;
+        Simulator<Trace> sim;
+        if (!sim.setMemorySize(isize, dsize)) job.result = "bad-memory-size";
+        else if (!makeDirs(dir)) job.result = "no-output-dir";
+        else if (!sim.loadImages(job.iimage.c_str(), job.dimage.c_str())) job.result = "load-failed";
+        else if (!sim.openReports((dir + "/snapshot.rpt").c_str(),
+            (dir + "/error_dump.rpt").c_str(), direct)) job.result = "no-reports";
+        else {
+            job.result = statusName(sim.run());
+            job.cycles = sim.getCycle();
+            if (!sim.closeReports()) job.result = "write-failed";
+        }
+        job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // jobs with the same instruction image as lanes of one lockstep run;
+    // each reports the wall time of the whole group
+    template <class Trace>
+    void runGroup(const std::vector<Job*>& group, const std::string& outdir, const bool direct) {
+        const auto start = std::chrono::steady_clock::now();
+        lockstep<Trace> sim;
+        std::vector<Job*> lanes;
+        if (!sim.setMemorySize(isize, dsize)) {
+            for (Job* job : group) job->result = "bad-memory-size";
+        } else if (!sim.loadInstr(group[0]->iimage.c_str())) {
+            for (Job* job : group) job->result = "load-failed";
+        } else {
+            for (Job* job : group) {
+                const std::string dir = outdir + "/" + job->name;
+                if (!makeDirs(dir)) job->result = "no-output-dir";
+                else if (!sim.addLane(job->dimage.c_str(), (dir + "/snapshot.rpt").c_str(),
+                    (dir + "/error_dump.rpt").c_str(), direct)) job->result = "load-failed";
+                else lanes.push_back(job);
+            }
+            sim.run();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            lanes[i]->result = sim.getResult(i).written ? statusName(sim.getResult(i).status) : "write-failed";
+            lanes[i]->cycles = sim.getResult(i).cycles;
+        }
+        for (Job* job : group) job->seconds = seconds;
+    }
+
+    // groups of up to width jobs whose instruction images are byte-identical
+    std::vector<std::vector<Job*>> groupJobs(std::vector<Job>& jobs, const size_t width) {
+        std::vector<std::vector<Job*>> groups;
+        std::map<std::string, size_t> open; // image contents to its last group
+        for (auto& job : jobs) {
+            std::ifstream in(job.iimage, std::ios::binary);
+            const std::string image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            const auto it = open.find(image);
+            if (it != open.end() && groups[it->second].size() < width) {
+                groups[it->second].push_back(&job);
+                continue;
+            }
+            open[image] = groups.size();
+            groups.push_back(std::vector<Job*>(1, &job));
+        }
+        return groups;
+    }
+
+    int usage(const char* argv0) {
+        fprintf(stderr, "usage: %s [-j threads] [-o outdir] [--direct] [--imem bytes] [--dmem bytes]\n"
+            "    [--trace full|errors|none] [--lockstep lanes]\n"
+            "    [--list file] [--pair iimage dimage]... [dir]...\n"
+            "  dir: every directory below it holding iimage.bin and dimage.bin\n"
+            "  list file: one \"iimage dimage [name]\" per line\n"
+            "  lockstep: step up to lanes jobs sharing an instruction image together\n", argv0);
+        return 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t threads = std::thread::hardware_concurrency();
+    std::string outdir = "batch";
+    bool direct = false;
+    void (*runner)(Job&, const std::string&, const bool) = runJob<TraceFull>;
+    void (*groupRunner)(const std::vector<Job*>&, const std::string&, const bool) = runGroup<TraceFull>;
+    size_t width = 0;
+    std::vector<Job> jobs;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) threads = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "-o" && i + 1 < argc) outdir = argv[++i];
+        else if (arg == "--direct") direct = true;
+        else if (arg == "--trace" && i + 1 < argc) {
+            const std::string trace = argv[++i];
+            if (trace == "full") {
+                runner = runJob<TraceFull>;
+                groupRunner = runGroup<TraceFull>;
+            } else if (trace == "errors") {
+                runner = runJob<TraceErrorsOnly>;
+                groupRunner = runGroup<TraceErrorsOnly>;
+            } else if (trace == "none") {
+                runner = runJob<TraceNone>;
+                groupRunner = runGroup<TraceNone>;
+            } else {
+                return usage(argv[0]);
+            }
+        }
+        else if (arg == "--lockstep" && i + 1 < argc) width = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--imem" && i + 1 < argc) isize = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--dmem" && i + 1 < argc) dsize = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--pair" && i + 2 < argc) {
+            Job job;
+            job.iimage = argv[++i];
+            job.dimage = argv[++i];
+            job.name = "job" + std::to_string(jobs.size());
+            jobs.push_back(job);
+        } else if (arg == "--list" && i + 1 < argc) {
+            FILE* list = fopen(argv[++i], "r");
+            if (list == nullptr) {
+                perror(argv[i]);
+                return 1;
+            }
+            char line[4096], ipath[2048], dpath[2048], name[256];
+            while (fgets(line, sizeof(line), list)) {
+                const int n = sscanf(line, "%2047s %2047s %255s", ipath, dpath, name);
+                if (n < 2 || ipath[0] == '#') continue;
+                Job job;
+                job.iimage = ipath;
+                job.dimage = dpath;
+                job.name = n == 3 ? name : "job" + std::to_string(jobs.size());
+                jobs.push_back(job);
+            }
+            fclose(list);
+        } else if (arg[0] != '-' && isDir(arg)) {
+            scan(arg, baseName(arg), jobs);
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (jobs.empty()) return usage(argv[0]);
+    // distinct output directories
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            if (jobs[j].name == jobs[i].name) {
+                jobs[i].name += "_" + std::to_string(i);
+                break;
+            }
+        }
+    }
+    if (!makeDirs(outdir)) {
+        perror(outdir.c_str());
+        return 1;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<std::vector<Job*>> groups = width > 0 ? groupJobs(jobs, width) : std::vector<std::vector<Job*>>();
+    threadpool pool(std::min(threads, width > 0 ? groups.size() : jobs.size()));
+    if (width > 0) {
+        for (const auto& group : groups) {
+            const std::vector<Job*>* g = &group;
+            pool.submit([g, &outdir, direct, groupRunner] { groupRunner(*g, outdir, direct); });
+        }
+    } else {
+        for (auto& job : jobs) {
+            Job* p = &job;
+            pool.submit([p, &outdir, direct, runner] { runner(*p, outdir, direct); });
+        }
+    }
+    pool.run();
+    const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const std::string summaryPath = outdir + "/summary.txt";
+    FILE* summary = fopen(summaryPath.c_str(), "w");
+    if (summary == nullptr) {
+        perror(summaryPath.c_str());
+        return 1;
+    }
+    size_t cycles = 0, failed = 0, unwritten = 0;
+    for (const auto& job : jobs) {
+        cycles += job.cycles;
+        if (strcmp(job.result, "halted") != 0) ++failed;
+        if (strcmp(job.result, "write-failed") == 0) ++unwritten;
+        fprintf(summary, "%s %s %zu %.6f\n", job.name.c_str(), job.result, job.cycles, job.seconds);
+    }
+    if (fclose(summary) != 0) {
+        perror(summaryPath.c_str());
+        return 1;
+    }
+    printf("%zu jobs on %zu threads, %zu not halted cleanly\n", jobs.size(), pool.size(), failed);
+    printf("%zu cycles in %.3f s, %.0f cycles/s\n", cycles, wall, wall > 0 ? cycles / wall : 0.0);
+    printf("per-job results in %s\n", summaryPath.c_str());
+    // the status of a job whose reports were cut short is lost with them
+    if (unwritten > 0) {
+        fprintf(stderr, "pipeline-batch: reports of %zu jobs could not be written\n", unwritten);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,321 @@
+#include "simulator.hpp"
+#include "interp.hpp"
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <vector>
+
+// pipeline-bench: generated workloads timed untraced, with the block cache,
+// on the threaded-code interpreter, fully traced inline and with the writer thread,
+// results printed and written as JSON for comparison across commits
+
+namespace {
+    uint32_t R(const uint32_t rs, const uint32_t rt, const uint32_t rd, const uint32_t shamt, const uint32_t funct) {
+        return (rs << 21) | (rt << 16) | (rd << 11) | (shamt << 6) | funct;
+    }
+
+    uint32_t I(const uint32_t opcode, const uint32_t rs, const uint32_t rt, const int32_t imm) {
+        return (opcode << 26) | (rs << 21) | (rt << 16) | (imm & 0xffff);
+    }
+
+    uint32_t J(const uint32_t opcode, const uint32_t target) {
+        return (opcode << 26) | (target & 0x3ffffff);
+    }
+
+    enum { ADDU = 0x21, SUB = 0x22, AND = 0x24, OR = 0x25, XOR = 0x26, NOR = 0x27, NAND = 0x28,
+        SLT = 0x2A, SLL = 0x00, SRL = 0x02, SRA = 0x03, JR = 0x08, MULT = 0x18, MULTU = 0x19,
+        MFHI = 0x10, MFLO = 0x12 };
+    enum { OP_J = 0x02, OP_JAL = 0x03, OP_BEQ = 0x04, OP_BNE = 0x05, OP_BGTZ = 0x07,
+        OP_ADDIU = 0x09, OP_SLTI = 0x0A, OP_ANDI = 0x0C, OP_ORI = 0x0D, OP_LUI = 0x0F,
+        OP_LB = 0x20, OP_LH = 0x21, OP_LW = 0x23, OP_LBU = 0x24, OP_SB = 0x28, OP_SW = 0x2B };
+    const uint32_t HALT_WORD = 0xFC000000;
+
+    // instruction words at PC 0 with branch targets by index
+    struct Program {
+        std::vector<uint32_t> words, data;
+        uint32_t here() const { return words.size(); }
+        void emit(const uint32_t w) { words.push_back(w); }
+        void branch(const uint32_t opcode, const uint32_t rs, const uint32_t rt, const uint32_t target) {
+            emit(I(opcode, rs, rt, int32_t(target) - int32_t(here() + 1)));
+        }
+        void li(const uint32_t rt, const uint32_t v) {
+            emit(I(OP_LUI, 0, rt, v >> 16));
+            emit(I(OP_ORI, rt, rt, v & 0xffff));
+        }
+        // $20 counts the loop down from n
+        uint32_t loop(const uint32_t n) {
+            li(20, n);
+            return here();
+        }
+        void endLoop(const uint32_t top) {
+            emit(I(OP_ADDIU, 20, 20, -1));
+            branch(OP_BGTZ, 20, 0, top);
+        }
+        void halt() { for (int i = 0; i < 5; ++i) emit(HALT_WORD); }
+    };
+
+    Program alu(const uint32_t n) {
+        Program p;
+        p.li(1, 0x12345678);
+        p.li(2, 0x9abcdef1);
+        const uint32_t top = p.loop(n);
+        p.emit(R(1, 2, 3, 0, ADDU));
+        p.emit(R(3, 1, 4, 0, XOR));
+        p.emit(R(4, 2, 5, 0, AND));
+        p.emit(R(5, 3, 6, 0, OR));
+        p.emit(R(6, 6, 7, 0, SUB));
+        p.emit(R(0, 4, 8, 7, SLL));
+        p.emit(R(0, 8, 9, 3, SRA));
+        p.emit(R(9, 5, 10, 0, NOR));
+        p.emit(R(10, 1, 11, 0, NAND));
+        p.emit(R(11, 9, 12, 0, SLT));
+        p.emit(R(0, 3, 1, 5, SRL));
+        p.emit(R(12, 11, 2, 0, ADDU));
+        p.endLoop(top);
+        p.halt();
+        return p;
+    }
+
+    // a pointer chase through a shuffled list of words, every load feeds the next
+    Program loadUse(const uint32_t n) {
+        Program p;
+        const uint32_t words = DATA_SIZE / 4;
+        p.data.resize(words);
+        uint32_t at = 0, step = 97;
+        for (uint32_t i = 0; i < words; ++i) {
+            const uint32_t next = (at + step) % words;
+            p.data[at] = next * 4;
+            at = next;
+        }
+        const uint32_t top = p.loop(n);
+        p.emit(I(OP_LW, 1, 1, 0));
+        p.emit(I(OP_LW, 1, 1, 0));
+        p.emit(I(OP_LW, 1, 2, 0));
+        p.emit(R(2, 3, 3, 0, ADDU));
+        p.emit(I(OP_LW, 2, 1, 0));
+        p.emit(R(1, 3, 4, 0, XOR));
+        p.endLoop(top);
+        p.halt();
+        return p;
+    }
+
+    // taken and not-taken branches on the loop counter, a jump and a call
+    Program branchy(const uint32_t n) {
+        Program p;
+        const uint32_t top = p.loop(n);
+        p.emit(I(OP_ANDI, 20, 1, 1));
+        const uint32_t beq = p.here();
+        p.emit(0);
+        p.emit(I(OP_ADDIU, 3, 3, 1));
+        p.words[beq] = I(OP_BEQ, 1, 0, int32_t(p.here()) - int32_t(beq + 1));
+        p.emit(I(OP_ANDI, 20, 2, 2));
+        const uint32_t bne = p.here();
+        p.emit(0);
+        p.emit(I(OP_ADDIU, 4, 4, 1));
+        p.words[bne] = I(OP_BNE, 2, 0, int32_t(p.here()) - int32_t(bne + 1));
+        const uint32_t jal = p.here();
+        p.emit(0);
+        p.emit(J(OP_J, (p.here() + 2)));
+        p.emit(I(OP_ADDIU, 6, 6, 1));
+        p.emit(I(OP_ADDIU, 6, 6, 1));
+        p.emit(R(3, 4, 7, 0, SLT));
+        p.endLoop(top);
+        p.halt();
+        const uint32_t sub = p.here();
+        p.words[jal] = J(OP_JAL, sub);
+        p.emit(I(OP_ADDIU, 5, 5, 1));
+        p.emit(R(31, 0, 0, 0, JR));
+        p.halt();
+        return p;
+    }
+
+    // every product read back before the next one, so no HI-LO overwrite
+    Program multHi(const uint32_t n) {
+        Program p;
+        p.li(1, 0x0001f00d);
+        p.li(2, 0xfffe1234);
+        const uint32_t top = p.loop(n);
+        p.emit(R(1, 2, 0, 0, MULT));
+        p.emit(R(0, 0, 3, 0, MFHI));
+        p.emit(R(0, 0, 4, 0, MFLO));
+        p.emit(R(3, 4, 0, 0, MULTU));
+        p.emit(R(0, 0, 5, 0, MFLO));
+        p.emit(R(0, 0, 6, 0, MFHI));
+        p.emit(I(OP_ADDIU, 1, 1, 3));
+        p.emit(R(5, 6, 2, 0, XOR));
+        p.endLoop(top);
+        p.halt();
+        return p;
+    }
+
+    // word, half and byte accesses over all of data memory up to its last byte
+    Program memSweep(const uint32_t n) {
+        Program p;
+        p.data.assign(DATA_SIZE / 4, 0x5a5aa5a5);
+        const uint32_t top = p.loop(n);
+        p.emit(I(OP_ORI, 0, 1, 0));
+        const uint32_t inner = p.here();
+        p.emit(I(OP_LW, 1, 2, 0));
+        p.emit(I(OP_LH, 1, 3, 2));
+        p.emit(I(OP_LBU, 1, 4, 3));
+        p.emit(R(2, 3, 5, 0, ADDU));
+        p.emit(I(OP_SW, 1, 5, 0));
+        p.emit(I(OP_SB, 1, 4, 1));
+        p.emit(I(OP_LB, 1, 6, 1));
+        p.emit(I(OP_ADDIU, 1, 1, 4));
+        p.emit(I(OP_SLTI, 1, 7, DATA_SIZE));
+        p.branch(OP_BNE, 7, 0, inner);
+        p.endLoop(top);
+        p.halt();
+        return p;
+    }
+
+    struct Workload {
+        const char* name;
+        Program (*build)(const uint32_t);
+        uint32_t iterations; // at scale 1, a few million cycles each
+    };
+
+    const Workload workloads[] = {
+        {"alu", alu, 200000},
+        {"load-use", loadUse, 300000},
+        {"branch", branchy, 200000},
+        {"mult-mfhi", multHi, 250000},
+        {"mem-sweep", memSweep, 1000},
+    };
+
+    struct Result {
+        const char* name;
+        const char* status = "halted";
+        size_t cycles = 0, retired = 0;
+        double simSeconds = 0, cacheSeconds = 0, interpSeconds = 0, fullSeconds = 0, asyncSeconds = 0;
+    };
+
+    template <class Trace>
+    bool runOnce(const Program& p, const std::string& dir, size_t& cycles, size_t& retired, double& seconds,
+        const bool cached = false)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        Simulator<Trace> sim;
+        sim.setBlockCache(cached);
+        sim.loadImages(0, p.words.data(), p.words.size(), DATA_SIZE, p.data.data(), p.data.size());
+        sim.setCycleLimit(SIZE_MAX);
+        if (!sim.openReports((dir + "/snapshot.rpt").c_str(), (dir + "/error_dump.rpt").c_str())) return false;
+        const SimulatorBase::Status status = sim.run();
+        sim.closeReports();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        cycles = sim.getCycle();
+        retired = sim.getRetired();
+        return status == SimulatorBase::HALTED;
+    }
+
+    bool runInterp(const Program& p, size_t& cycles, size_t& retired, double& seconds) {
+        const auto start = std::chrono::steady_clock::now();
+        interp sim;
+        sim.loadImages(0, p.words.data(), p.words.size(), DATA_SIZE, p.data.data(), p.data.size());
+        sim.setCycleLimit(SIZE_MAX);
+        const SimulatorBase::Status status = sim.run();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        cycles = sim.getCycle();
+        retired = sim.getRetired();
+        return status == SimulatorBase::HALTED;
+    }
+
+    int usage(const char* argv0) {
+        fprintf(stderr, "usage: %s [-o file.json] [--label name] [--scale n] [--repeat n] [workload]...\n"
+            "  workloads: alu load-use branch mult-mfhi mem-sweep\n", argv0);
+        return 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* out = "bench.json";
+    const char* label = "";
+    double scale = 1;
+    int repeat = 3;
+    std::vector<const Workload*> chosen;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) out = argv[++i];
+        else if (arg == "--label" && i + 1 < argc) label = argv[++i];
+        else if (arg == "--scale" && i + 1 < argc) scale = strtod(argv[++i], nullptr);
+        else if (arg == "--repeat" && i + 1 < argc) repeat = atoi(argv[++i]);
+        else {
+            const Workload* w = nullptr;
+            for (const auto& c : workloads) if (arg == c.name) w = &c;
+            if (w == nullptr) return usage(argv[0]);
+            chosen.push_back(w);
+        }
+    }
+    if (scale <= 0 || repeat < 1) return usage(argv[0]);
+    if (chosen.empty()) for (const auto& w : workloads) chosen.push_back(&w);
+
+    // the traced runs write real reports, into a scratch directory
+    char tmpl[] = "/tmp/pipeline-bench.XXXXXX";
+    if (mkdtemp(tmpl) == nullptr) {
+        perror("pipeline-bench");
+        return 1;
+    }
+    const std::string dir = tmpl;
+
+    std::vector<Result> results;
+    printf("%-10s %12s %12s %9s %9s %9s %9s %9s %10s %10s\n",
+        "workload", "cycles", "instrs", "sim s", "cache s", "interp s", "report s", "async s", "Mcycle/s", "MIPS");
+    for (const Workload* w : chosen) {
+        const Program p = w->build(uint32_t(w->iterations * scale) + 1);
+        Result r;
+        r.name = w->name;
+        // best of repeat, untraced for the simulation alone, then fully traced
+        for (int k = 0; k < repeat; ++k) {
+            size_t cycles = 0, retired = 0, cacheCycles = 0, cacheRetired = 0, asyncCycles = 0, asyncRetired = 0;
+            size_t interpCycles = 0, interpRetired = 0;
+            double none = 0, cache = 0, interpreted = 0, full = 0, async = 0;
+            if (!runOnce<TraceNone>(p, dir, r.cycles, r.retired, none) ||
+                !runOnce<TraceNone>(p, dir, cacheCycles, cacheRetired, cache, true) ||
+                !runInterp(p, interpCycles, interpRetired, interpreted) ||
+                !runOnce<TraceFull>(p, dir, cycles, retired, full) ||
+                !runOnce<TraceAsync>(p, dir, asyncCycles, asyncRetired, async)) {
+                r.status = "not-halted";
+            } else if (cycles != r.cycles || retired != r.retired ||
+                cacheCycles != r.cycles || cacheRetired != r.retired ||
+                interpCycles != r.cycles || interpRetired != r.retired ||
+                asyncCycles != r.cycles || asyncRetired != r.retired) {
+                r.status = "mismatch";
+            }
+            if (k == 0 || none < r.simSeconds) r.simSeconds = none;
+            if (k == 0 || cache < r.cacheSeconds) r.cacheSeconds = cache;
+            if (k == 0 || interpreted < r.interpSeconds) r.interpSeconds = interpreted;
+            if (k == 0 || full < r.fullSeconds) r.fullSeconds = full;
+            if (k == 0 || async < r.asyncSeconds) r.asyncSeconds = async;
+        }
+        const double report = std::max(0.0, r.fullSeconds - r.simSeconds);
+        printf("%-10s %12zu %12zu %9.4f %9.4f %9.4f %9.4f %9.4f %10.1f %10.1f%s%s\n", r.name, r.cycles, r.retired,
+            r.simSeconds, r.cacheSeconds, r.interpSeconds, report, r.asyncSeconds, r.cycles / r.simSeconds / 1e6, r.retired / r.simSeconds / 1e6,
+            strcmp(r.status, "halted") == 0 ? "" : "  ", strcmp(r.status, "halted") == 0 ? "" : r.status);
+        results.push_back(r);
+    }
+    unlink((dir + "/snapshot.rpt").c_str());
+    unlink((dir + "/error_dump.rpt").c_str());
+    rmdir(dir.c_str());
+
+    FILE* json = fopen(out, "w");
+    if (json == nullptr) {
+        perror(out);
+        return 1;
+    }
+    fprintf(json, "{\n  \"label\": \"%s\",\n  \"scale\": %g,\n  \"repeat\": %d,\n  \"workloads\": [\n",
+        label, scale, repeat);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        fprintf(json, "    {\"name\": \"%s\", \"status\": \"%s\", \"cycles\": %zu, \"instructions\": %zu, "
+            "\"sim_seconds\": %.6f, \"cache_seconds\": %.6f, \"interp_seconds\": %.6f, \"report_seconds\": %.6f, \"wall_seconds\": %.6f, \"async_wall_seconds\": %.6f, "
+            "\"cycles_per_second\": %.0f, \"instructions_per_second\": %.0f}%s\n",
+            r.name, r.status, r.cycles, r.retired, r.simSeconds, r.cacheSeconds, r.interpSeconds,
+            std::max(0.0, r.fullSeconds - r.simSeconds), r.fullSeconds, r.asyncSeconds,
+            r.cycles / r.simSeconds, r.retired / r.simSeconds, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(json, "  ]\n}\n");
+    fclose(json);
+    printf("results in %s\n", out);
+    return 0;
+}
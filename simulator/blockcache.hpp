@@ -0,0 +1,65 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include "counters.hpp"
+
+// per-cycle flags of a block: a real instruction in EX, in WB
+#define BLOCK_EX 0x1
+#define BLOCK_WB 0x2
+
+// the control state of the pipeline at the top of a cycle: PC and the slot
+// in each latch. Stalls, flushes and forwarding up to the next branch or jr
+// ID resolves follow from it alone, whatever the data
+struct BlockKey {
+    bool operator==(const BlockKey& rhs) const {
+        return PC == rhs.PC && IF_ID == rhs.IF_ID && ID_EX == rhs.ID_EX &&
+            EX_MEM == rhs.EX_MEM && MEM_WB == rhs.MEM_WB;
+    }
+    uint32_t PC, IF_ID, ID_EX, EX_MEM, MEM_WB;
+};
+
+// the cycles from one control state through the cycle in which ID resolves
+// a branch or jr, or a bounded run of them without one
+struct Block {
+    enum End : uint8_t { END_LENGTH, END_BRANCH, END_JR };
+    std::vector<uint8_t> cycles; // BLOCK_EX | BLOCK_WB
+    std::vector<uint32_t> path; // slots through ID in order, the last one ends the block
+    // per path entry the fetch PC as ID saw it, which jal links; not 4 past
+    // the slot's address after a jr to an unaligned target
+    std::vector<uint32_t> jalPC;
+    counters events; // all but the flush of a taken branch
+    size_t retired = 0, ex = 0; // cycles with BLOCK_WB, with BLOCK_EX
+    End end = END_LENGTH;
+    // the state after the block: [0] not taken or END_LENGTH, [1] taken or
+    // jr, whose PC is the target seen when it was recorded
+    BlockKey next[2];
+    bool known[2] = {false, false};
+    Block* link[2] = {nullptr, nullptr}; // next[i] once found, never for jr
+};
+
+// blocks recorded from the pipeline, by the state they start in
+class blockcache {
+public:
+    static const size_t kMaxCycles = 256;
+    Block* find(const BlockKey& k) {
+        const auto it = blocks_.find(k);
+        return it == blocks_.end() ? nullptr : &it->second;
+    }
+    // the block for k, fresh if there was none
+    Block& insert(const BlockKey& k, bool& fresh) {
+        const auto r = blocks_.emplace(k, Block());
+        fresh = r.second;
+        return r.first->second;
+    }
+    const size_t size() const { return blocks_.size(); }
+
+private:
+    struct Hash {
+        size_t operator()(const BlockKey& k) const {
+            uint64_t h = (uint64_t(k.PC) << 32 | k.IF_ID) * 0x9e3779b97f4a7c15ULL;
+            h ^= (uint64_t(k.ID_EX) << 42 ^ uint64_t(k.EX_MEM) << 21 ^ k.MEM_WB) * 0xc2b2ae3d27d4eb4fULL;
+            return h ^ (h >> 29);
+        }
+    };
+    std::unordered_map<BlockKey, Block, Hash> blocks_;
+};
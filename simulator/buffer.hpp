@@ -1,23 +1,64 @@
 #pragma once
+#include "irfile.hpp"
+#include "checkpoint.hpp"
+
+// slot: index into memory's predecoded table, 0 is the NOP bubble
 
 struct IFID_Buffer {
-    uint32_t instr = 0, rs, rt;
+    void serialize(checkpoint& c) { c.io(slot); }
+    uint32_t slot = 0;
 };
 
 struct IDEX_Buffer {
-    char type = 'R';
-    uint32_t instr = 0, opcode, rs, rt, rd, shamt, funct, C, rs_data, rt_data, jalPC;
+    void serialize(checkpoint& c) {
+        c.io(slot);
+        c.io(rs_data);
+        c.io(rt_data);
+        c.io(jalPC);
+    }
+    uint32_t slot = 0, rs_data, rt_data, jalPC;
 };
 
 struct EXMEM_Buffer {
-    uint32_t instr = 0, opcode = 0, ALU_Result, WriteDest, isHILO = 0; // HI: 0x01, LO: 0x10
+    void serialize(checkpoint& c) {
+        c.io(slot);
+        c.io(ALU_Result);
+        c.io(WriteDest);
+        c.io(isHILO);
+        c.io(MemWrite);
+        c.io(MemRead);
+        c.io(RegWrite);
+    }
+    // scoreboard: the register this instruction writes, $0 excluded
+    uint32_t destMask() const { return RegWrite ? (1u << WriteDest) & ~1u : 0; }
+    uint32_t slot = 0, ALU_Result, WriteDest, isHILO = 0; // HI: 0x01, LO: 0x10
     bool MemWrite = false, MemRead = false, RegWrite = false;
 };
 
 struct MEMWB_Buffer {
-    MEMWB_Buffer() = default;
-    MEMWB_Buffer(const MEMWB_Buffer& rhs) : instr(rhs.instr), rt_data(rhs.rt_data),
-        WriteDest(rhs.WriteDest), RegWrite(rhs.RegWrite) {};
-    uint32_t instr = 0, rt_data, WriteDest;
+    void serialize(checkpoint& c) {
+        c.io(slot);
+        c.io(rt_data);
+        c.io(WriteDest);
+        c.io(RegWrite);
+        c.io(RegPrint);
+    }
+    uint32_t destMask() const { return RegWrite ? (1u << WriteDest) & ~1u : 0; }
+    uint32_t slot = 0, rt_data, WriteDest;
     bool RegWrite = false, RegPrint = false;
 };
+
+// stage annotation bits, printed in this order
+#define NOTE_STALLED 0x01 // to_be_stalled
+#define NOTE_FLUSHED 0x02 // to_be_flushed
+#define NOTE_FWD_EXDM_RS 0x04 // fwd_EX-DM_rs_$rs
+#define NOTE_FWD_DMWB_RS 0x08 // fwd_DM-WB_rs_$rs
+#define NOTE_FWD_EXDM_RT 0x10 // fwd_EX-DM_rt_$rt
+#define NOTE_FWD_DMWB_RT 0x20 // fwd_DM-WB_rt_$rt
+
+// snapshot label of a stage, formatted only when printed
+struct StageLabel {
+    StageLabel(const uint8_t op = IR::OP_NONE) : op(op) {}
+    bool isHalt() const { return op == IR::OP_HALT && note == 0; }
+    uint8_t op, note = 0, rs = 0, rt = 0;
+};
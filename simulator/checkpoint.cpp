@@ -0,0 +1,92 @@
+#include "checkpoint.hpp"
+#include <cstring>
+
+namespace {
+    const char kMagic[8] = {'P', 'I', 'P', 'E', 'C', 'K', 'P', 'T'};
+}
+
+bool checkpoint::openWrite(const char* path) {
+    close();
+    file_ = fopen(path, "wb");
+    saving_ = ok_ = file_ != nullptr;
+    if (!ok_) return false;
+    uint32_t version = CHECKPOINT_VERSION;
+    raw(const_cast<char*>(kMagic), sizeof(kMagic));
+    io(version);
+    return ok_;
+}
+
+bool checkpoint::openRead(const char* path) {
+    close();
+    file_ = fopen(path, "rb");
+    saving_ = false;
+    ok_ = file_ != nullptr;
+    if (!ok_) return false;
+    char magic[sizeof(kMagic)];
+    uint32_t version = 0;
+    raw(magic, sizeof(magic));
+    io(version);
+    ok_ = ok_ && memcmp(magic, kMagic, sizeof(kMagic)) == 0 && version == CHECKPOINT_VERSION;
+    return ok_;
+}
+
+bool checkpoint::close() {
+    if (file_ == nullptr) return ok_;
+    if (saving_ && fflush(file_) != 0) ok_ = false;
+    if (fclose(file_) != 0) ok_ = false;
+    file_ = nullptr;
+    return ok_;
+}
+
+// fields are stored little-endian
+void checkpoint::io(uint64_t& v) {
+    uint8_t b[8];
+    if (saving_) {
+        for (int i = 0; i < 8; ++i) b[i] = v >> (8 * i);
+        raw(b, 8);
+    } else {
+        raw(b, 8);
+        v = 0;
+        for (int i = 0; i < 8; ++i) v |= uint64_t(b[i]) << (8 * i);
+    }
+}
+
+void checkpoint::io(uint32_t& v) {
+    uint8_t b[4];
+    if (saving_) {
+        for (int i = 0; i < 4; ++i) b[i] = v >> (8 * i);
+        raw(b, 4);
+    } else {
+        raw(b, 4);
+        v = 0;
+        for (int i = 0; i < 4; ++i) v |= uint32_t(b[i]) << (8 * i);
+    }
+}
+
+void checkpoint::io(uint8_t& v) { raw(&v, 1); }
+
+void checkpoint::io(bool& v) {
+    uint8_t b = v;
+    io(b);
+    v = b != 0;
+}
+
+void checkpoint::io(char& v) { raw(&v, 1); }
+
+void checkpoint::io(uint32_t* p, const size_t n) {
+    for (size_t i = 0; i < n; ++i) io(p[i]);
+}
+
+void checkpoint::io(uint8_t* p, const size_t n) { raw(p, n); }
+
+void checkpoint::ioSize(size_t& v) {
+    uint64_t w = v;
+    io(w);
+    v = w;
+}
+
+void checkpoint::raw(void* p, const size_t n) {
+    if (!ok_) return;
+    const size_t done = saving_ ? fwrite(p, 1, n, file_) : fread(p, 1, n, file_);
+    if (done != n) ok_ = false;
+}
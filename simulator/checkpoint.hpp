@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+
+#define CHECKPOINT_VERSION 5
+
+// versioned binary snapshot of the simulator state
+// the same io() calls save or load depending on how it was opened
+class checkpoint {
+public:
+    checkpoint() {}
+    checkpoint(const checkpoint&) = delete;
+    checkpoint& operator=(const checkpoint&) = delete;
+    ~checkpoint() { close(); }
+    bool openWrite(const char*);
+    bool openRead(const char*);
+    // false if any field failed to transfer
+    bool close();
+    const bool saving() const { return saving_; }
+    const bool ok() const { return ok_; }
+    void io(uint64_t&);
+    void io(uint32_t&);
+    void io(uint8_t&);
+    void io(bool&);
+    void io(char&);
+    void io(uint32_t*, const size_t);
+    void io(uint8_t*, const size_t);
+    void ioSize(size_t&);
+
+private:
+    void raw(void*, const size_t);
+    FILE* file_ = nullptr;
+    bool saving_ = false, ok_ = false;
+};
@@ -0,0 +1,52 @@
+#include "counters.hpp"
+
+counters& counters::operator+=(const counters& rhs) {
+    loadUseStalls += rhs.loadUseStalls;
+    branchStalls += rhs.branchStalls;
+    branchFlushes += rhs.branchFlushes;
+    jumpFlushes += rhs.jumpFlushes;
+    fwdExDmRs += rhs.fwdExDmRs;
+    fwdExDmRt += rhs.fwdExDmRt;
+    fwdDmWbRs += rhs.fwdDmWbRs;
+    fwdDmWbRt += rhs.fwdDmWbRt;
+    return *this;
+}
+
+counters counters::operator-(const counters& rhs) const {
+    counters c;
+    c.loadUseStalls = loadUseStalls - rhs.loadUseStalls;
+    c.branchStalls = branchStalls - rhs.branchStalls;
+    c.branchFlushes = branchFlushes - rhs.branchFlushes;
+    c.jumpFlushes = jumpFlushes - rhs.jumpFlushes;
+    c.fwdExDmRs = fwdExDmRs - rhs.fwdExDmRs;
+    c.fwdExDmRt = fwdExDmRt - rhs.fwdExDmRt;
+    c.fwdDmWbRs = fwdDmWbRs - rhs.fwdDmWbRs;
+    c.fwdDmWbRt = fwdDmWbRt - rhs.fwdDmWbRt;
+    return c;
+}
+
+void counters::print(FILE* f, const size_t cycles, const size_t retired) const {
+    const double n = retired ? double(retired) : 1.0;
+    const size_t bubbles = loadUseStalls + branchStalls + branchFlushes + jumpFlushes;
+    // fill, drain and HALT: whatever the events and the instructions leave
+    const size_t other = cycles > retired + bubbles ? cycles - retired - bubbles : 0;
+    fprintf(f, "cycles %zu, instructions %zu, CPI %.3f\n", cycles, retired, cycles / n);
+    fprintf(f, "  %-18s %7.3f\n", "base", retired ? 1.0 : 0.0);
+    fprintf(f, "  %-18s %7.3f  %zu cycles\n", "load-use stalls", loadUseStalls / n, loadUseStalls);
+    fprintf(f, "  %-18s %7.3f  %zu cycles\n", "branch/jr stalls", branchStalls / n, branchStalls);
+    fprintf(f, "  %-18s %7.3f  %zu cycles\n", "branch flushes", branchFlushes / n, branchFlushes);
+    fprintf(f, "  %-18s %7.3f  %zu cycles\n", "jump flushes", jumpFlushes / n, jumpFlushes);
+    fprintf(f, "  %-18s %7.3f  %zu cycles\n", "fill/drain", other / n, other);
+    fprintf(f, "forwarding: EX-DM rs %zu, EX-DM rt %zu, DM-WB rs %zu, DM-WB rt %zu\n",
+        fwdExDmRs, fwdExDmRt, fwdDmWbRs, fwdDmWbRt);
+}
+
+void counters::printJSON(FILE* f, const size_t cycles, const size_t retired) const {
+    fprintf(f, "{\n  \"cycles\": %zu,\n  \"instructions\": %zu,\n  \"cpi\": %.6f,\n"
+        "  \"load_use_stalls\": %zu,\n  \"branch_stalls\": %zu,\n"
+        "  \"branch_flushes\": %zu,\n  \"jump_flushes\": %zu,\n"
+        "  \"forwarding\": {\"ex_dm_rs\": %zu, \"ex_dm_rt\": %zu, \"dm_wb_rs\": %zu, \"dm_wb_rt\": %zu}\n}\n",
+        cycles, retired, retired ? double(cycles) / retired : 0.0,
+        loadUseStalls, branchStalls, branchFlushes, jumpFlushes,
+        fwdExDmRs, fwdExDmRt, fwdDmWbRs, fwdDmWbRt);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdio>
+#include "checkpoint.hpp"
+
+// pipeline events, counted under every trace policy
+struct counters {
+    void serialize(checkpoint& c) {
+        c.ioSize(loadUseStalls);
+        c.ioSize(branchStalls);
+        c.ioSize(branchFlushes);
+        c.ioSize(jumpFlushes);
+        c.ioSize(fwdExDmRs);
+        c.ioSize(fwdExDmRt);
+        c.ioSize(fwdDmWbRs);
+        c.ioSize(fwdDmWbRt);
+    }
+    counters& operator+=(const counters&);
+    counters operator-(const counters&) const;
+    // CPI split into the cycles each event costs
+    void print(FILE*, const size_t cycles, const size_t retired) const;
+    void printJSON(FILE*, const size_t cycles, const size_t retired) const;
+
+    size_t loadUseStalls = 0, branchStalls = 0; // branchStalls: beq, bne, bgtz and jr
+    size_t branchFlushes = 0, jumpFlushes = 0; // taken branches; j, jal and jr
+    // forwarding in EX and in ID, by the path the snapshot names
+    size_t fwdExDmRs = 0, fwdExDmRt = 0, fwdDmWbRs = 0, fwdDmWbRt = 0;
+};
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// pipeline-difftest: run this simulator and a golden one side by side on
+// FIFOs in place of their reports, compare the reports as they are
+// written and stop both at the first cycle that differs
+
+namespace {
+    const char* sideName[2] = {"golden", "pipeline"};
+
+    // the register, PC and stage lines of a cycle, keyed by their label
+    typedef std::map<std::string, std::string> State;
+
+    struct Block {
+        size_t cycle;
+        std::string text;
+    };
+
+    struct ErrorLine {
+        size_t cycle;
+        std::string text;
+    };
+
+    // one report of one simulator, split into lines as it arrives
+    struct Stream {
+        int fd = -1;
+        bool eof = false;
+        std::string partial;
+    };
+
+    struct Side {
+        std::string dir;
+        pid_t pid = -1;
+        bool exited = false;
+        Stream snapshot, errors;
+        std::deque<Block> blocks; // complete cycles not compared yet
+        Block open; // the cycle being received
+        bool inBlock = false;
+        std::deque<ErrorLine> errorLines;
+        size_t lastError = 0; // cycle of the latest error line received
+    };
+
+    // cycles both sides agreed on: folded into base once no error
+    // difference can still land on them, kept in history until then
+    struct Agreed {
+        State base;
+        std::deque<Block> history;
+    };
+
+    size_t cycleOf(const std::string& line, const char* prefix) {
+        const size_t n = strlen(prefix);
+        if (line.compare(0, n, prefix) != 0) return SIZE_MAX;
+        return strtoull(line.c_str() + n, nullptr, 10);
+    }
+
+    void snapshotLine(Side& side, const std::string& line) {
+        const size_t cycle = cycleOf(line, "cycle ");
+        if (cycle != SIZE_MAX) {
+            if (side.inBlock) side.blocks.push_back(side.open);
+            side.open.cycle = cycle;
+            side.open.text.clear();
+            side.inBlock = true;
+        }
+        if (side.inBlock && !line.empty()) side.open.text += line + "\n";
+    }
+
+    void errorLine(Side& side, const std::string& line) {
+        if (line.empty()) return;
+        side.errorLines.push_back({cycleOf(line, "In cycle "), line});
+        side.lastError = side.errorLines.back().cycle;
+    }
+
+    // read what is there, false at end of file
+    bool drain(Stream& s, Side& side, void (*onLine)(Side&, const std::string&)) {
+        char buf[1 << 16];
+        const ssize_t n = read(s.fd, buf, sizeof(buf));
+        if (n < 0) return errno == EAGAIN || errno == EINTR;
+        if (n == 0) {
+            s.eof = true;
+            if (!s.partial.empty()) onLine(side, s.partial);
+            s.partial.clear();
+            return false;
+        }
+        s.partial.append(buf, n);
+        size_t begin = 0, end;
+        while ((end = s.partial.find('\n', begin)) != std::string::npos) {
+            onLine(side, s.partial.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        s.partial.erase(0, begin);
+        return true;
+    }
+
+    void finishSnapshot(Side& side) {
+        if (side.snapshot.eof && side.inBlock) {
+            side.blocks.push_back(side.open);
+            side.inBlock = false;
+        }
+    }
+
+    void apply(State& state, const std::string& text) {
+        size_t begin = 0, end;
+        while ((end = text.find('\n', begin)) != std::string::npos) {
+            const std::string line = text.substr(begin, end - begin);
+            const size_t colon = line.find(": ");
+            if (colon != std::string::npos) state[line.substr(0, colon)] = line.substr(colon + 2);
+            begin = end + 1;
+        }
+    }
+
+    bool makeFifo(const std::string& path, Stream& s) {
+        if (mkfifo(path.c_str(), 0600) != 0) return false;
+        // open before the writer exists, so neither side blocks in open()
+        s.fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+        return s.fd >= 0;
+    }
+
+    bool linkImage(const std::string& dir, const char* images, const char* name) {
+        char real[PATH_MAX];
+        const std::string src = std::string(images) + "/" + name;
+        if (realpath(src.c_str(), real) == nullptr) return false;
+        return symlink(real, (dir + "/" + name).c_str()) == 0;
+    }
+
+    pid_t spawn(const std::string& dir, const char* bin) {
+        const pid_t pid = fork();
+        if (pid > 0) setpgid(pid, pid);
+        if (pid != 0) return pid;
+        // its own group, so a wrapper script goes down with everything it started
+        setpgid(0, 0);
+        if (chdir(dir.c_str()) != 0) _exit(127);
+        const int out = open("stdout", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out >= 0) dup2(out, STDOUT_FILENO);
+        execl(bin, bin, static_cast<char*>(nullptr));
+        _exit(127);
+    }
+
+    std::string readFile(const std::string& path) {
+        std::string s;
+        FILE* f = fopen(path.c_str(), "r");
+        if (f == nullptr) return s;
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.append(buf, n);
+        fclose(f);
+        return s;
+    }
+
+    void cleanup(Side& side) {
+        if (side.pid > 0 && !side.exited) {
+            kill(-side.pid, SIGKILL);
+            waitpid(side.pid, nullptr, 0);
+        }
+        if (side.snapshot.fd >= 0) close(side.snapshot.fd);
+        if (side.errors.fd >= 0) close(side.errors.fd);
+        const char* files[] = {"snapshot.rpt", "error_dump.rpt", "iimage.bin", "dimage.bin", "stdout"};
+        for (const char* f : files) unlink((side.dir + "/" + f).c_str());
+        rmdir(side.dir.c_str());
+    }
+
+    // the whole pipeline state of both sides at the diverging cycle
+    void printState(Side (&sides)[2], const Agreed& agreed, const size_t cycle, const char* what) {
+        printf("first difference in cycle %zu (%s)\n", cycle, what);
+        State state[2];
+        for (int k = 0; k < 2; ++k) {
+            state[k] = agreed.base;
+            for (const char* stage : {"PC", "IF", "ID", "EX", "DM", "WB"}) state[k][stage] = "-";
+            bool found = false;
+            for (const auto& b : agreed.history) {
+                if (b.cycle > cycle) break;
+                apply(state[k], b.text);
+                found = b.cycle == cycle;
+            }
+            if (!found && !sides[k].blocks.empty() && sides[k].blocks.front().cycle == cycle)
+                apply(state[k], sides[k].blocks.front().text);
+        }
+        printf("%-5s %-40s %s\n", "", sideName[0], sideName[1]);
+        char label[8];
+        for (int r = 0; r < 40; ++r) {
+            const char* key = label;
+            if (r < 32) snprintf(label, sizeof(label), "$%02d", r);
+            else {
+                const char* rest[] = {"$HI", "$LO", "PC", "IF", "ID", "EX", "DM", "WB"};
+                key = rest[r - 32];
+            }
+            const std::string& a = state[0][key];
+            const std::string& b = state[1][key];
+            printf("%-5s %-40s %s%s\n", key, a.c_str(), b.c_str(), a == b ? "" : "  <");
+        }
+        for (int k = 0; k < 2; ++k) {
+            for (const auto& e : sides[k].errorLines) {
+                if (e.cycle == cycle) printf("%s: %s\n", sideName[k], e.text.c_str());
+            }
+        }
+    }
+
+    int usage(const char* argv0) {
+        fprintf(stderr, "usage: %s [--golden binary] [--sim binary] [dir]\n"
+            "  dir holds iimage.bin and dimage.bin, default .\n", argv0);
+        return 2;
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* golden = "../archiTA/simulator/pipeline";
+    const char* sim = "./pipeline";
+    const char* images = ".";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) golden = argv[++i];
+        else if (strcmp(argv[i], "--sim") == 0 && i + 1 < argc) sim = argv[++i];
+        else if (argv[i][0] != '-') images = argv[i];
+        else return usage(argv[0]);
+    }
+    char bins[2][PATH_MAX];
+    for (int k = 0; k < 2; ++k) {
+        const char* bin = k == 0 ? golden : sim;
+        if (realpath(bin, bins[k]) == nullptr) {
+            fprintf(stderr, "pipeline-difftest: cannot find %s\n", bin);
+            return 2;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    Side sides[2];
+    bool ready = true;
+    for (int k = 0; k < 2 && ready; ++k) {
+        char tmpl[] = "/tmp/pipeline-difftest.XXXXXX";
+        if (mkdtemp(tmpl) == nullptr) {
+            ready = false;
+            break;
+        }
+        sides[k].dir = tmpl;
+        ready = linkImage(sides[k].dir, images, "iimage.bin") &&
+            linkImage(sides[k].dir, images, "dimage.bin") &&
+            makeFifo(sides[k].dir + "/snapshot.rpt", sides[k].snapshot) &&
+            makeFifo(sides[k].dir + "/error_dump.rpt", sides[k].errors);
+    }
+    if (!ready) {
+        perror("pipeline-difftest");
+        for (auto& side : sides) if (!side.dir.empty()) cleanup(side);
+        return 2;
+    }
+    for (int k = 0; k < 2; ++k) sides[k].pid = spawn(sides[k].dir, bins[k]);
+
+    // compared: every cycle below it matched in both reports
+    size_t compared = 0, errorAt = SIZE_MAX, snapshotAt = SIZE_MAX;
+    Agreed agreed;
+    while (snapshotAt == SIZE_MAX) {
+        pollfd fds[4];
+        Stream* streams[4];
+        Side* owners[4];
+        bool snap[4];
+        int n = 0;
+        for (auto& side : sides) {
+            for (Stream* s : {&side.snapshot, &side.errors}) {
+                if (s->eof) continue;
+                fds[n] = {s->fd, POLLIN, 0};
+                streams[n] = s;
+                owners[n] = &side;
+                snap[n++] = s == &side.snapshot;
+            }
+        }
+        if (n == 0) break;
+        const int ready = poll(fds, n, 100);
+        if (ready < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; ++i) {
+            if (fds[i].revents == 0) {
+                // a simulator that exited without opening the report never will
+                if (owners[i]->exited) {
+                    streams[i]->eof = true;
+                    if (snap[i]) finishSnapshot(*owners[i]);
+                }
+                continue;
+            }
+            if (!drain(*streams[i], *owners[i], snap[i] ? snapshotLine : errorLine) && snap[i])
+                finishSnapshot(*owners[i]);
+        }
+        for (auto& side : sides) {
+            if (!side.exited && side.pid > 0 && waitpid(side.pid, nullptr, WNOHANG) == side.pid)
+                side.exited = true;
+        }
+
+        // error_dump: line by line in order
+        std::deque<ErrorLine> &ea = sides[0].errorLines, &eb = sides[1].errorLines;
+        size_t matched = 0;
+        while (errorAt == SIZE_MAX && matched < ea.size() && matched < eb.size()) {
+            if (ea[matched].text != eb[matched].text)
+                errorAt = std::min(ea[matched].cycle, eb[matched].cycle);
+            else ++matched;
+        }
+        if (errorAt == SIZE_MAX) {
+            ea.erase(ea.begin(), ea.begin() + matched);
+            eb.erase(eb.begin(), eb.begin() + matched);
+            // one side ended while the other still reports an error
+            if (sides[0].errors.eof && !eb.empty()) errorAt = eb.front().cycle;
+            if (sides[1].errors.eof && !ea.empty()) errorAt = ea.front().cycle;
+        }
+
+        // snapshot: cycle by cycle, up to an error difference
+        std::deque<Block> &ba = sides[0].blocks, &bb = sides[1].blocks;
+        while (!ba.empty() && !bb.empty() && std::min(ba.front().cycle, bb.front().cycle) < errorAt) {
+            if (ba.front().cycle != bb.front().cycle || ba.front().text != bb.front().text) {
+                snapshotAt = std::min(ba.front().cycle, bb.front().cycle);
+                break;
+            }
+            compared = ba.front().cycle + 1;
+            agreed.history.push_back(ba.front());
+            ba.pop_front();
+            bb.pop_front();
+        }
+        // a later error difference is at or after the last line each side sent
+        size_t settled = SIZE_MAX;
+        for (const auto& side : sides) {
+            if (!side.errors.eof) settled = std::min(settled, side.lastError);
+        }
+        if (errorAt != SIZE_MAX) settled = std::min(settled, errorAt);
+        while (!agreed.history.empty() && agreed.history.front().cycle < settled) {
+            apply(agreed.base, agreed.history.front().text);
+            agreed.history.pop_front();
+        }
+        if (snapshotAt == SIZE_MAX) {
+            // one side ended early
+            if (sides[0].snapshot.eof && ba.empty() && !bb.empty()) snapshotAt = bb.front().cycle;
+            if (sides[1].snapshot.eof && bb.empty() && !ba.empty()) snapshotAt = ba.front().cycle;
+        }
+        const bool snapshotDone = sides[0].snapshot.eof && sides[1].snapshot.eof &&
+            ba.empty() && bb.empty();
+        // an error difference stands once the snapshots have caught up with it
+        if (errorAt != SIZE_MAX && (compared >= errorAt || snapshotDone)) break;
+    }
+
+    int result = 0;
+    if (errorAt != SIZE_MAX && errorAt <= snapshotAt) {
+        printState(sides, agreed, errorAt, "error_dump.rpt");
+        result = 1;
+    } else if (snapshotAt != SIZE_MAX) {
+        printState(sides, agreed, snapshotAt, "snapshot.rpt");
+        result = 1;
+    } else {
+        for (auto& side : sides) {
+            if (!side.exited && side.pid > 0) waitpid(side.pid, nullptr, 0);
+            side.exited = true;
+        }
+        const std::string out[2] = {readFile(sides[0].dir + "/stdout"), readFile(sides[1].dir + "/stdout")};
+        if (out[0] != out[1]) {
+            printf("reports match through cycle %zu, stdout differs\n", compared ? compared - 1 : 0);
+            for (int k = 0; k < 2; ++k) printf("%s: %s", sideName[k], out[k].c_str());
+            result = 1;
+        } else {
+            printf("reports match, %zu cycles\n", compared);
+        }
+    }
+    for (auto& side : sides) cleanup(side);
+    return result;
+}
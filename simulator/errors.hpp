@@ -0,0 +1,9 @@
+#pragma once
+// ERR constant
+#define ERR_WRITE_REG_ZERO 0x1 // continue
+#define ERR_NUMBER_OVERFLOW 0x10  // continue
+#define ERR_OVERWRTIE_REG_HI_LO 0x100 // continue
+#define ERR_ADDRESS_OVERFLOW 0x1000 // halt
+#define ERR_MISALIGNMENT 0x10000 // halt
+#define ERR_ILLEGAL 0x100000
+#define HALT (ERR_ADDRESS_OVERFLOW | ERR_MISALIGNMENT | ERR_ILLEGAL) // halt
@@ -0,0 +1,861 @@
+#include "simulator.hpp"
+#include "interp.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <malloc.h>
+#include <memory>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// pipeline-fuzz: random programs biased toward hazards, generated and run
+// in memory, checked against a functional reference interpreter; a failing
+// case is minimised and written out as images
+
+namespace {
+    // raw encodings, as the images hold them
+    uint32_t R(const uint32_t rs, const uint32_t rt, const uint32_t rd, const uint32_t shamt, const uint32_t funct) {
+        return (rs << 21) | (rt << 16) | (rd << 11) | (shamt << 6) | funct;
+    }
+
+    uint32_t I(const uint32_t opcode, const uint32_t rs, const uint32_t rt, const int32_t imm) {
+        return (opcode << 26) | (rs << 21) | (rt << 16) | (imm & 0xffff);
+    }
+
+    uint32_t J(const uint32_t opcode, const uint32_t target) {
+        return (opcode << 26) | (target & 0x3ffffff);
+    }
+
+    enum { ADD = 0x20, ADDU = 0x21, SUB = 0x22, AND = 0x24, OR = 0x25, XOR = 0x26, NOR = 0x27,
+        NAND = 0x28, SLT = 0x2A, SLL = 0x00, SRL = 0x02, SRA = 0x03, JR = 0x08, MULT = 0x18,
+        MULTU = 0x19, MFHI = 0x10, MFLO = 0x12 };
+    enum { OP_R = 0x00, OP_J = 0x02, OP_JAL = 0x03, OP_BEQ = 0x04, OP_BNE = 0x05, OP_BGTZ = 0x07,
+        OP_ADDI = 0x08, OP_ADDIU = 0x09, OP_SLTI = 0x0A, OP_ANDI = 0x0C, OP_ORI = 0x0D,
+        OP_NORI = 0x0E, OP_LUI = 0x0F, OP_LB = 0x20, OP_LH = 0x21, OP_LW = 0x23, OP_LBU = 0x24,
+        OP_LHU = 0x25, OP_SB = 0x28, OP_SH = 0x29, OP_SW = 0x2B, OP_HALT = 0x3F };
+    const uint32_t HALT_WORD = 0xFC000000;
+    // loop counter and jr target, never picked as a destination
+    const uint32_t LOOP_REG = 26, TARGET_REG = 27;
+
+    // error_dump.rpt lines, in the order the counts are kept
+    const char* const errorNames[] = {
+        "Write $0 Error", "Address Overflow", "Misalignment Error",
+        "Overwrite HI-LO registers", "Number Overflow"
+    };
+    enum { E_REG_ZERO, E_ADDRESS, E_MISALIGN, E_HILO, E_OVERFLOW, E_COUNT };
+
+    // splitmix64, cheap to seed once per case unlike mt19937
+    struct splitmix {
+        explicit splitmix(const uint64_t seed) : s(seed) {}
+        uint64_t operator()() {
+            uint64_t z = (s += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+        uint64_t s;
+    };
+
+    struct Case {
+        uint32_t PC0 = 0, SP = 0;
+        std::vector<uint32_t> words, data;
+    };
+
+    /**
+    * Generator
+    */
+
+    class generator {
+    public:
+        generator(const uint64_t seed, const uint64_t dsize) : rng_(seed), dsize_(dsize) {}
+        Case make(const size_t templates);
+
+    private:
+        uint32_t pick(const uint32_t n) { return rng_() % n; }
+        bool chance(const uint32_t percent) { return pick(100) < percent; }
+        // few registers, so that instructions depend on each other
+        uint32_t src() {
+            const uint32_t r = pick(12);
+            return r < 9 ? r : r == 9 ? 31 : r == 10 ? 29 : 1 + pick(8);
+        }
+        uint32_t dst() { return chance(3) ? 0 : chance(5) ? 31 : 1 + pick(8); }
+        uint32_t value();
+        void li(const uint32_t rt, const uint32_t v) {
+            if (v >> 16) {
+                emit(I(OP_LUI, 0, rt, v >> 16));
+                emit(I(OP_ORI, rt, rt, v & 0xffff));
+            } else {
+                emit(I(OP_ORI, 0, rt, v));
+            }
+        }
+        void emit(const uint32_t w) { c_.words.push_back(w); }
+        // forward past n templates after this one, fixed up at the end;
+        // targets are template starts so that no li is cut from its use
+        void forward(const uint32_t w, const uint32_t n, const char kind) {
+            fix_.push_back({c_.words.size(), c_.words.size(), n, kind});
+            emit(w);
+        }
+        uint32_t address(const uint32_t width);
+        void alu();
+        void aluImm();
+        void load(const bool use);
+        void store();
+        void hilo();
+        void branch();
+        void jump();
+        void jr();
+        void loop();
+        void straight();
+
+        // at: the word patched, from: the branch or jr; off: bytes past the
+        // target, for a jr to an unaligned address
+        struct Fixup { size_t at, from, skip; char kind; uint32_t off; };
+        splitmix rng_;
+        uint64_t dsize_;
+        bool faults_ = false; // a case that may end in an address error
+        Case c_;
+        std::vector<Fixup> fix_;
+        std::vector<size_t> starts_; // of the templates
+    };
+
+    // values at the edges of the ALU and of data memory
+    uint32_t generator::value() {
+        switch (pick(12)) {
+            case 0: return 0;
+            case 1: return 1;
+            case 2: return 0x7fffffff;
+            case 3: return 0x80000000;
+            case 4: return 0xffffffff;
+            case 5: return 0x7ffffffe;
+            case 6: return uint32_t(dsize_ - 4);
+            case 7: return uint32_t(dsize_);
+            case 8: return pick(64);
+            default: return uint32_t(rng_());
+        }
+    }
+
+    // in bounds and aligned, often at the end; in a faulting case sometimes
+    // past the end or misaligned
+    uint32_t generator::address(const uint32_t width) {
+        const uint32_t words = uint32_t(dsize_ / width);
+        if (faults_ && chance(8)) return uint32_t(dsize_) - width + pick(2 * width);
+        if (faults_ && chance(4)) return pick(uint32_t(dsize_)) | 1;
+        if (chance(30)) return uint32_t(dsize_) - width * (1 + pick(4));
+        return width * pick(words);
+    }
+
+    void generator::alu() {
+        static const uint32_t functs[] = {ADD, ADDU, SUB, AND, OR, XOR, NOR, NAND, SLT, SLL, SRL, SRA};
+        const uint32_t f = functs[pick(12)];
+        if (f == SLL || f == SRL || f == SRA) emit(R(0, src(), dst(), pick(32), f));
+        else emit(R(src(), src(), dst(), 0, f));
+    }
+
+    void generator::aluImm() {
+        static const uint32_t ops[] = {OP_ADDI, OP_ADDIU, OP_LUI, OP_ANDI, OP_ORI, OP_NORI, OP_SLTI};
+        const uint32_t op = ops[pick(7)];
+        const int32_t imm = chance(30) ? int32_t(value()) : int32_t(pick(0x10000)) - 0x8000;
+        emit(I(op, op == OP_LUI ? 0 : src(), dst(), imm));
+    }
+
+    // use: the next instruction reads the loaded register
+    void generator::load(const bool use) {
+        static const uint32_t ops[] = {OP_LW, OP_LH, OP_LHU, OP_LB, OP_LBU};
+        static const uint32_t widths[] = {4, 2, 2, 1, 1};
+        const uint32_t k = pick(5), base = 1 + pick(8);
+        const int32_t off = (int32_t(pick(5)) - 2) * int32_t(widths[k]);
+        if (faults_ && chance(5)) {
+            // whatever the register holds
+            emit(I(ops[k], base, dst(), off));
+            return;
+        }
+        li(base, address(widths[k]) - off);
+        const uint32_t rt = dst();
+        emit(I(ops[k], base, rt, off));
+        if (!use || rt == 0) return;
+        switch (pick(4)) {
+            case 0: emit(R(rt, src(), dst(), 0, ADDU)); break;
+            case 1: emit(R(src(), rt, dst(), 0, SUB)); break;
+            case 2: emit(I(k == 0 ? OP_SW : k < 3 ? OP_SH : OP_SB, base, rt, off)); break;
+            default: forward(I(OP_BEQ, rt, src(), 0), pick(3), 'b'); break;
+        }
+    }
+
+    void generator::store() {
+        static const uint32_t ops[] = {OP_SW, OP_SH, OP_SB};
+        static const uint32_t widths[] = {4, 2, 1};
+        const uint32_t k = pick(3), base = 1 + pick(8);
+        li(base, address(widths[k]));
+        emit(I(ops[k], base, src(), 0));
+        // read it straight back
+        static const uint32_t loads[] = {OP_LW, OP_LHU, OP_LB};
+        if (chance(40)) emit(I(loads[k], base, dst(), 0));
+    }
+
+    // mult after mult overwrites HI/LO unread
+    void generator::hilo() {
+        const uint32_t n = 2 + pick(4);
+        for (uint32_t i = 0; i < n; ++i) {
+            switch (pick(4)) {
+                case 0: emit(R(src(), src(), 0, 0, MULT)); break;
+                case 1: emit(R(src(), src(), 0, 0, MULTU)); break;
+                case 2: emit(R(0, 0, dst(), 0, MFHI)); break;
+                default: emit(R(0, 0, dst(), 0, MFLO)); break;
+            }
+        }
+    }
+
+    // back to back, and right behind the instruction producing the operand
+    void generator::branch() {
+        const uint32_t n = 1 + (chance(40) ? 1 + pick(2) : 0);
+        for (uint32_t i = 0; i < n; ++i) {
+            const uint32_t rs = src(), rt = src();
+            if (chance(40)) emit(I(OP_ADDIU, src(), rs == 0 ? 1 : rs, int32_t(pick(5)) - 2));
+            static const uint32_t ops[] = {OP_BEQ, OP_BNE, OP_BGTZ};
+            const uint32_t op = ops[pick(3)];
+            forward(I(op, rs, op == OP_BGTZ ? (chance(20) ? rt : 0) : rt, 0), pick(5), 'b');
+        }
+    }
+
+    void generator::jump() {
+        forward(J(chance(50) ? OP_J : OP_JAL, 0), pick(4), 'j');
+    }
+
+    // target in a register, written just before or loaded from memory;
+    // sometimes unaligned, onto a jal that links the PC it was fetched from
+    void generator::jr() {
+        const size_t at = c_.words.size();
+        const uint32_t filler = pick(3);
+        const bool odd = chance(15);
+        const Fixup fix = {at, 0, odd ? 0 : pick(4), 'r', odd ? 1 + pick(3) : 0};
+        if (chance(30)) {
+            const uint32_t base = 1 + pick(8), addr = 4 * pick(uint32_t(dsize_ / 4));
+            fix_.push_back(fix);
+            emit(I(OP_ORI, 0, TARGET_REG, 0));
+            li(base, addr);
+            emit(I(OP_SW, base, TARGET_REG, 0));
+            emit(I(OP_LW, base, TARGET_REG, 0));
+        } else {
+            fix_.push_back(fix);
+            emit(I(OP_ORI, 0, TARGET_REG, 0));
+        }
+        for (uint32_t i = 0; i < filler; ++i) alu();
+        // the target lies past the jr
+        fix_.back().from = c_.words.size();
+        emit(R(TARGET_REG, 0, 0, 0, JR));
+        if (!odd) return;
+        // the jal starts a template of its own, the one the jr lands in
+        starts_.push_back(c_.words.size());
+        forward(J(OP_JAL, 0), pick(4), 'j');
+    }
+
+    // a short counted loop around instructions that cannot leave it
+    void generator::loop() {
+        emit(I(OP_ORI, 0, LOOP_REG, 1 + pick(5)));
+        const size_t top = c_.words.size();
+        const uint32_t n = 1 + pick(4);
+        for (uint32_t i = 0; i < n; ++i) straight();
+        if (chance(25)) {
+            // a jr just past the next word's address and a jal back onto the
+            // word grid, so the block cache replays a jal fetched unaligned
+            const uint32_t addr = c_.PC0 + 4 * uint32_t(c_.words.size() + 2);
+            emit(I(OP_ORI, 0, TARGET_REG, int32_t(addr + 1 + pick(3))));
+            emit(R(TARGET_REG, 0, 0, 0, JR));
+            emit(J(OP_JAL, (addr + 4) >> 2));
+        }
+        emit(I(OP_ADDIU, LOOP_REG, LOOP_REG, -1));
+        emit(I(OP_BGTZ, LOOP_REG, 0, int32_t(top) - int32_t(c_.words.size() + 1)));
+    }
+
+    void generator::straight() {
+        switch (pick(6)) {
+            case 0: case 1: alu(); break;
+            case 2: aluImm(); break;
+            case 3: load(true); break;
+            case 4: store(); break;
+            default: hilo(); break;
+        }
+    }
+
+    Case generator::make(const size_t templates) {
+        c_ = Case();
+        fix_.clear();
+        starts_.clear();
+        faults_ = chance(40);
+        c_.PC0 = 4 * pick(16);
+        c_.SP = chance(50) ? uint32_t(dsize_) : 4 * pick(uint32_t(dsize_ / 4));
+        c_.data.resize(size_t(dsize_ / 4));
+        // edge values, data addresses and noise, mostly from one draw
+        for (auto& w : c_.data) {
+            const uint64_t r = rng_();
+            w = r % 4 == 0 ? value() : r % 4 == 1 ? 4 * uint32_t((r >> 2) % (dsize_ / 4)) : uint32_t(r >> 32);
+        }
+        for (uint32_t r = 1; r <= 8; ++r) li(r, value());
+        for (size_t i = 0; i < templates; ++i) {
+            starts_.push_back(c_.words.size());
+            switch (pick(20)) {
+                case 0: case 1: case 2: case 3: alu(); break;
+                case 4: case 5: aluImm(); break;
+                case 6: case 7: case 8: load(true); break;
+                case 9: load(false); break;
+                case 10: case 11: store(); break;
+                case 12: case 13: hilo(); break;
+                case 14: case 15: branch(); break;
+                case 16: jump(); break;
+                case 17: jr(); break;
+                case 18: loop(); break;
+                default: emit(0); break;
+            }
+        }
+        // every forward target lands on or before the first HALT
+        starts_.push_back(c_.words.size());
+        for (int i = 0; i < 5; ++i) emit(HALT_WORD);
+        for (const Fixup& f : fix_) {
+            const size_t next = std::upper_bound(starts_.begin(), starts_.end(), f.from) - starts_.begin();
+            const size_t target = starts_[std::min(next + f.skip, starts_.size() - 1)];
+            const uint32_t addr = c_.PC0 + 4 * uint32_t(target);
+            uint32_t& w = c_.words[f.at];
+            switch (f.kind) {
+                case 'b': w = (w & 0xffff0000) | ((target - f.at - 1) & 0xffff); break;
+                case 'j': w = (w & 0xfc000000) | (addr >> 2); break;
+                case 'r': w = (w & 0xffff0000) | (addr + f.off); break;
+            }
+        }
+        return c_;
+    }
+
+    /**
+    * Reference
+    * one instruction at a time from the raw words, no pipeline at all
+    */
+
+    struct Outcome {
+        SimulatorBase::Status status = SimulatorBase::RUNNING;
+        size_t retired = 0, steps = 0; // steps: bubbles outside the image too
+        uint32_t reg[32] = {}, HI = 0, LO = 0;
+        std::vector<uint8_t> mem;
+        size_t errors[E_COUNT] = {};
+    };
+
+    uint32_t sext16(const uint32_t v) { return v & 0x8000 ? v | 0xffff0000 : v & 0xffff; }
+
+    Outcome reference(const Case& c, const uint64_t dsize, const size_t maxSteps) {
+        Outcome o;
+        o.mem.assign(size_t(dsize), 0);
+        for (size_t i = 0; i < c.data.size() && 4 * i + 3 < dsize; ++i) {
+            for (int b = 0; b < 4; ++b) o.mem[4 * i + b] = c.data[i] >> (24 - 8 * b);
+        }
+        o.reg[29] = c.SP;
+        uint32_t PC = c.PC0;
+        bool locked = false;
+        for (size_t step = 0; step < maxSteps; ++step) {
+            const uint32_t idx = (PC - c.PC0) / 4;
+            // outside the image is a bubble, not an instruction
+            const bool inside = PC >= c.PC0 && idx < c.words.size();
+            const uint32_t w = inside ? c.words[idx] : 0;
+            const uint32_t opcode = w >> 26, rs = (w >> 21) & 0x1f, rt = (w >> 16) & 0x1f,
+                rd = (w >> 11) & 0x1f, shamt = (w >> 6) & 0x1f, funct = w & 0x3f;
+            const uint32_t a = o.reg[rs], b = o.reg[rt], C = w & 0xffff, simm = sext16(C);
+            uint32_t next = PC + 4;
+            int dest = -1;
+            uint32_t result = 0;
+            // the pipeline stops once HALT fills every stage, a HALT short of
+            // that passes through like a bubble
+            if (opcode == OP_HALT) {
+                bool run = idx + 5 <= c.words.size();
+                for (uint32_t k = 1; run && k < 5; ++k) run = c.words[idx + k] >> 26 == OP_HALT;
+                if (run) {
+                    o.status = SimulatorBase::HALTED;
+                    return o;
+                }
+                ++o.steps;
+                PC += 4;
+                continue;
+            }
+            switch (opcode) {
+                case OP_R: {
+                    if ((w & 0x1FFFFF) == 0) break;
+                    dest = rd;
+                    switch (funct) {
+                        case ADD: {
+                            result = a + b;
+                            if (isOverflow(a, b, result)) ++o.errors[E_OVERFLOW];
+                            break;
+                        }
+                        case ADDU: result = a + b; break;
+                        case SUB: {
+                            result = a - b;
+                            if (isSubOverflow(a, b, result)) ++o.errors[E_OVERFLOW];
+                            break;
+                        }
+                        case AND: result = a & b; break;
+                        case OR: result = a | b; break;
+                        case XOR: result = a ^ b; break;
+                        case NOR: result = ~(a | b); break;
+                        case NAND: result = ~(a & b); break;
+                        case SLT: result = int32_t(a) < int32_t(b); break;
+                        case SLL: result = b << shamt; break;
+                        case SRL: result = b >> shamt; break;
+                        case SRA: result = int32_t(b) >> shamt; break;
+                        case JR: dest = -1; next = a; break;
+                        case MULT: case MULTU: {
+                            const uint64_t m = funct == MULT ?
+                                uint64_t(int64_t(int32_t(a)) * int64_t(int32_t(b))) : uint64_t(a) * b;
+                            if (locked) ++o.errors[E_HILO];
+                            locked = true;
+                            o.HI = m >> 32;
+                            o.LO = uint32_t(m);
+                            dest = -1;
+                            break;
+                        }
+                        case MFHI: result = o.HI; locked = false; break;
+                        case MFLO: result = o.LO; locked = false; break;
+                        default: result = 0; break;
+                    }
+                    break;
+                }
+                case OP_J: case OP_JAL: {
+                    if (opcode == OP_JAL) {
+                        dest = 31;
+                        result = PC + 4;
+                    }
+                    next = ((PC + 4) & 0xf0000000) | ((w & 0x3ffffff) << 2);
+                    break;
+                }
+                case OP_BEQ: if (a == b) next = PC + 4 + (simm << 2); break;
+                case OP_BNE: if (a != b) next = PC + 4 + (simm << 2); break;
+                case OP_BGTZ: if (int32_t(a) > 0) next = PC + 4 + (simm << 2); break;
+                case OP_ADDI: {
+                    dest = rt;
+                    result = a + simm;
+                    if (isOverflow(a, simm, result)) ++o.errors[E_OVERFLOW];
+                    break;
+                }
+                case OP_ADDIU: dest = rt; result = a + simm; break;
+                case OP_SLTI: dest = rt; result = int32_t(a) < int32_t(simm); break;
+                case OP_ANDI: dest = rt; result = a & C; break;
+                case OP_ORI: dest = rt; result = a | C; break;
+                case OP_NORI: dest = rt; result = ~(a | C); break;
+                case OP_LUI: dest = rt; result = C << 16; break;
+                case OP_LW: case OP_LH: case OP_LHU: case OP_LB: case OP_LBU:
+                case OP_SW: case OP_SH: case OP_SB: {
+                    const uint32_t addr = a + simm;
+                    if (isOverflow(a, simm, addr)) ++o.errors[E_OVERFLOW];
+                    const uint32_t width = opcode == OP_LW || opcode == OP_SW ? 4 :
+                        opcode == OP_LH || opcode == OP_LHU || opcode == OP_SH ? 2 : 1;
+                    const bool outside = uint64_t(addr) + width > dsize, misaligned = addr % width != 0;
+                    if (outside || misaligned) {
+                        if (outside) ++o.errors[E_ADDRESS];
+                        if (misaligned) ++o.errors[E_MISALIGN];
+                        o.status = SimulatorBase::ERROR;
+                        return o;
+                    }
+                    if (opcode == OP_SW || opcode == OP_SH || opcode == OP_SB) {
+                        for (uint32_t k = 0; k < width; ++k) o.mem[addr + k] = b >> (8 * (width - 1 - k));
+                        break;
+                    }
+                    uint32_t v = 0;
+                    for (uint32_t k = 0; k < width; ++k) v = (v << 8) | o.mem[addr + k];
+                    if (opcode == OP_LH) v = sext16(v);
+                    if (opcode == OP_LB) v = v & 0x80 ? v | 0xffffff00 : v;
+                    dest = rt;
+                    result = v;
+                    break;
+                }
+                default: {
+                    o.status = SimulatorBase::ILLEGAL;
+                    return o;
+                }
+            }
+            if (dest == 0) ++o.errors[E_REG_ZERO];
+            else if (dest > 0) o.reg[dest] = result;
+            if (inside) ++o.retired;
+            ++o.steps;
+            PC = next;
+        }
+        return o;
+    }
+
+    /**
+    * Pipeline
+    * reports go to memory files, nothing touches the disk
+    */
+
+    struct memfile {
+        explicit memfile(const char* name) : fd(memfd_create(name, 0)), path("/proc/self/fd/" + std::to_string(fd)) {}
+        ~memfile() { if (fd >= 0) close(fd); }
+        std::string read() const {
+            struct stat st;
+            if (fstat(fd, &st) != 0) return std::string();
+            std::string s(size_t(st.st_size), '\0');
+            if (pread(fd, &s[0], s.size(), 0) != ssize_t(s.size())) s.clear();
+            return s;
+        }
+        memfile(const memfile&) = delete;
+        memfile& operator=(const memfile&) = delete;
+        int fd;
+        std::string path;
+    };
+
+    // the error_dump.rpt lines counted by kind; false if a line is malformed
+    // or the cycles go backwards
+    bool countErrors(const std::string& dump, const size_t cycles, size_t (&errors)[E_COUNT]) {
+        size_t pos = 0, last = 0;
+        while (pos < dump.size()) {
+            const size_t eol = dump.find('\n', pos);
+            if (eol == std::string::npos) return false;
+            const std::string line = dump.substr(pos, eol - pos);
+            pos = eol + 1;
+            unsigned long long cycle;
+            int n = 0;
+            if (sscanf(line.c_str(), "In cycle %llu: %n", &cycle, &n) != 1 || n == 0) return false;
+            if (cycle < last || cycle > cycles) return false;
+            last = cycle;
+            int k = 0;
+            while (k < E_COUNT && line.compare(n, std::string::npos, errorNames[k]) != 0) ++k;
+            if (k == E_COUNT) return false;
+            ++errors[k];
+        }
+        return true;
+    }
+
+    struct Config {
+        uint64_t isize = INSTR_SIZE, dsize = DATA_SIZE;
+        size_t templates = 40, maxSteps = 100000;
+        bool blockCache = false; // also run with the block cache, cycle for cycle the same
+        bool interp = false; // also run on the threaded-code interpreter, the same again
+    };
+
+    // the same case with the block cache against the pipeline run without it
+    std::string checkCached(const Case& c, const Config& cfg, memfile& error_dump,
+        const Simulator<TraceErrorsOnly>& plain)
+    {
+        const std::string dump = error_dump.read();
+        Simulator<TraceErrorsOnly> sim;
+        sim.setMemorySize(cfg.isize, cfg.dsize);
+        sim.loadImages(c.PC0, c.words.data(), c.words.size(), c.SP, c.data.data(), c.data.size());
+        sim.setCycleLimit(plain.getStatus() == SimulatorBase::LIMIT ? plain.getCycle() : SIZE_MAX);
+        sim.setBlockCache(true);
+        if (!sim.openReports("/dev/null", error_dump.path.c_str())) return "reports not opened";
+        sim.run();
+        sim.closeReports();
+        const counters& a = sim.getCounters();
+        const counters& b = plain.getCounters();
+        const regfile& ra = sim.getRegfile();
+        const regfile& rb = plain.getRegfile();
+        bool same = sim.getStatus() == plain.getStatus() && sim.getCycle() == plain.getCycle() &&
+            sim.getRetired() == plain.getRetired() && ra.getHI() == rb.getHI() && ra.getLO() == rb.getLO() &&
+            memcmp(&a, &b, sizeof(counters)) == 0 && error_dump.read() == dump;
+        for (int r = 0; r < 32; ++r) same &= ra.getReg(r) == rb.getReg(r);
+        for (uint64_t x = 0; same && x < cfg.dsize; x += 4)
+            same = sim.getMemory().loadWord(x) == plain.getMemory().loadWord(x);
+        if (same) return std::string();
+        char msg[160];
+        snprintf(msg, sizeof(msg), "cache: %zu cycles, %zu retired, pipeline %zu, %zu",
+            sim.getCycle(), sim.getRetired(), plain.getCycle(), plain.getRetired());
+        return msg;
+    }
+
+    // the same case on the threaded-code interpreter against the pipeline
+    std::string checkInterp(const Case& c, const Config& cfg, memfile& error_dump,
+        const Simulator<TraceErrorsOnly>& plain)
+    {
+        const std::string dump = error_dump.read();
+        interp sim;
+        sim.setMemorySize(cfg.isize, cfg.dsize);
+        sim.loadImages(c.PC0, c.words.data(), c.words.size(), c.SP, c.data.data(), c.data.size());
+        sim.setCycleLimit(plain.getStatus() == SimulatorBase::LIMIT ? plain.getCycle() : SIZE_MAX);
+        if (!sim.openReports("/dev/null", error_dump.path.c_str())) return "reports not opened";
+        sim.run();
+        sim.closeReports();
+        const counters& a = sim.getCounters();
+        const counters& b = plain.getCounters();
+        const regfile& ra = sim.getRegfile();
+        const regfile& rb = plain.getRegfile();
+        bool same = sim.getStatus() == plain.getStatus() && sim.getCycle() == plain.getCycle() &&
+            sim.getRetired() == plain.getRetired() && ra.getHI() == rb.getHI() && ra.getLO() == rb.getLO() &&
+            sim.getMemory().getPC() == plain.getMemory().getPC() &&
+            memcmp(&a, &b, sizeof(counters)) == 0 && error_dump.read() == dump;
+        for (int r = 0; r < 32; ++r) same &= ra.getReg(r) == rb.getReg(r);
+        for (uint64_t x = 0; same && x < cfg.dsize; x += 4)
+            same = sim.getMemory().loadWord(x) == plain.getMemory().loadWord(x);
+        if (same) return std::string();
+        char msg[160];
+        snprintf(msg, sizeof(msg), "interp: %zu cycles, %zu retired, pipeline %zu, %zu",
+            sim.getCycle(), sim.getRetired(), plain.getCycle(), plain.getRetired());
+        return msg;
+    }
+
+    // empty if the pipeline agrees with the reference, else what differs;
+    // ended: how the reference ended, RUNNING if it did not and nothing ran
+    std::string check(const Case& c, const Config& cfg, memfile& error_dump,
+        SimulatorBase::Status& ended) {
+        const Outcome ref = reference(c, cfg.dsize, cfg.maxSteps);
+        ended = ref.status;
+        if (ref.status == SimulatorBase::RUNNING) return std::string();
+        Simulator<TraceErrorsOnly> sim;
+        if (!sim.setMemorySize(cfg.isize, cfg.dsize)) return "bad memory size";
+        sim.loadImages(c.PC0, c.words.data(), c.words.size(), c.SP, c.data.data(), c.data.size());
+        // at most two stalls and a flush per instruction, plus fill and drain
+        sim.setCycleLimit(4 * ref.steps + 16);
+        // the snapshot only gets the final registers, which are read directly
+        if (!sim.openReports("/dev/null", error_dump.path.c_str())) return "reports not opened";
+        const SimulatorBase::Status status = sim.run();
+        sim.closeReports();
+        char msg[160];
+        if (status != ref.status) {
+            snprintf(msg, sizeof(msg), "status %d, reference %d", status, ref.status);
+            return msg;
+        }
+        if (sim.getRetired() != ref.retired) {
+            snprintf(msg, sizeof(msg), "retired %zu, reference %zu", sim.getRetired(), ref.retired);
+            return msg;
+        }
+        const regfile& reg = sim.getRegfile();
+        for (int r = 0; r < 32; ++r) {
+            if (reg.getReg(r) != ref.reg[r]) {
+                snprintf(msg, sizeof(msg), "register $%02d 0x%08X, reference 0x%08X", r, reg.getReg(r), ref.reg[r]);
+                return msg;
+            }
+        }
+        // a mult behind the faulting access has already written HI/LO
+        if (status == SimulatorBase::HALTED && (reg.getHI() != ref.HI || reg.getLO() != ref.LO)) {
+            snprintf(msg, sizeof(msg), "HI/LO 0x%08X/0x%08X, reference 0x%08X/0x%08X",
+                reg.getHI(), reg.getLO(), ref.HI, ref.LO);
+            return msg;
+        }
+        const memory& mem = sim.getMemory();
+        for (uint64_t a = 0; a < cfg.dsize; ++a) {
+            // a word at a time until one differs
+            if (a % 4 == 0 && mem.loadWord(a) == (uint32_t(ref.mem[a]) << 24 | ref.mem[a + 1] << 16 |
+                ref.mem[a + 2] << 8 | ref.mem[a + 3])) {
+                a += 3;
+                continue;
+            }
+            if (mem.loadByte(a) != ref.mem[a]) {
+                snprintf(msg, sizeof(msg), "data 0x%08llX 0x%02X, reference 0x%02X",
+                    (unsigned long long)a, mem.loadByte(a), ref.mem[a]);
+                return msg;
+            }
+        }
+        size_t errors[E_COUNT] = {};
+        if (!countErrors(error_dump.read(), sim.getCycle(), errors)) return "errors: malformed error_dump.rpt";
+        for (int k = 0; k < E_COUNT; ++k) {
+            // instructions behind the faulting one may add errors in its cycle
+            const bool exact = status == SimulatorBase::HALTED || k == E_ADDRESS || k == E_MISALIGN;
+            if (exact ? errors[k] != ref.errors[k] : errors[k] < ref.errors[k]) {
+                snprintf(msg, sizeof(msg), "errors %zu \"%s\", reference %zu", errors[k], errorNames[k], ref.errors[k]);
+                return msg;
+            }
+        }
+        // every cycle is a step of the reference, a stall or flush, or fill and drain
+        const counters& ev = sim.getCounters();
+        const size_t bubbles = ev.loadUseStalls + ev.branchStalls + ev.branchFlushes + ev.jumpFlushes;
+        if (status == SimulatorBase::HALTED && sim.getCycle() != ref.steps + bubbles + 4) {
+            snprintf(msg, sizeof(msg), "cycles %zu for %zu steps and %zu bubbles",
+                sim.getCycle(), ref.steps, bubbles);
+            return msg;
+        }
+        const std::string cached = cfg.blockCache ? checkCached(c, cfg, error_dump, sim) : std::string();
+        if (!cached.empty() || !cfg.interp) return cached;
+        return checkInterp(c, cfg, error_dump, sim);
+    }
+
+    /**
+    * Minimiser
+    * NOPs in place of instructions keep every target where it was, zeroes
+    * in place of data words; a change is kept while the same check fails
+    */
+
+    std::string kind(const std::string& failure) { return failure.substr(0, failure.find(' ')); }
+
+    Case minimise(Case c, const Config& cfg, memfile& error_dump) {
+        SimulatorBase::Status ended;
+        const std::string want = kind(check(c, cfg, error_dump, ended));
+        const auto fails = [&](const Case& t) {
+            const std::string f = check(t, cfg, error_dump, ended);
+            return !f.empty() && kind(f) == want;
+        };
+        const auto shrink = [&](std::vector<uint32_t>& v, const uint32_t blank, const size_t end) {
+            for (size_t chunk = std::max<size_t>(end / 2, 1);; chunk /= 2) {
+                for (size_t at = 0; at < end; at += chunk) {
+                    std::vector<uint32_t> keep(v.begin() + at, v.begin() + std::min(at + chunk, end));
+                    bool changed = false;
+                    for (size_t i = at; i < std::min(at + chunk, end); ++i) {
+                        changed |= v[i] != blank;
+                        v[i] = blank;
+                    }
+                    if (changed && !fails(c)) std::copy(keep.begin(), keep.end(), v.begin() + at);
+                }
+                if (chunk == 1) return;
+            }
+        };
+        // the HALTs at the end stay
+        shrink(c.words, 0, c.words.size() - 5);
+        shrink(c.data, 0, c.data.size());
+        // then drop the NOPs that nothing needs for its address
+        for (size_t i = c.words.size() - 5; i-- > 0;) {
+            if (c.words[i] != 0) continue;
+            Case t = c;
+            t.words.erase(t.words.begin() + i);
+            if (fails(t)) c = t;
+        }
+        while (!c.data.empty() && c.data.back() == 0) c.data.pop_back();
+        return c;
+    }
+
+    bool writeImage(const std::string& path, const uint32_t head, const std::vector<uint32_t>& words) {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (f == nullptr) return false;
+        std::vector<uint32_t> be;
+        be.push_back(ToBig(head));
+        be.push_back(ToBig(uint32_t(words.size())));
+        for (const uint32_t w : words) be.push_back(ToBig(w));
+        const bool ok = fwrite(be.data(), 4, be.size(), f) == be.size();
+        return fclose(f) == 0 && ok;
+    }
+
+    void list(FILE* f, const Case& c) {
+        for (size_t i = 0; i < c.words.size(); ++i) {
+            const IR::Decoded d = IR::decode(c.words[i]);
+            fprintf(f, "  0x%08X: 0x%08X %s", c.PC0 + 4 * uint32_t(i), c.words[i], IR::Ops[d.op].name);
+            switch (d.type) {
+                case 'R': fprintf(f, " rs=$%u rt=$%u rd=$%u shamt=%u\n", d.rs, d.rt, d.rd, d.shamt); break;
+                case 'I': fprintf(f, " rs=$%u rt=$%u imm=0x%04X\n", d.rs, d.rt, d.C); break;
+                case 'J': fprintf(f, " target=0x%08X\n", d.C << 2); break;
+                default: fprintf(f, "\n"); break;
+            }
+        }
+    }
+
+    // one per thread, with its own error_dump.rpt
+    struct Worker {
+        std::unique_ptr<memfile> error_dump;
+        size_t cases = 0, instrs = 0, halted = 0, faulted = 0;
+        uint64_t failed = 0; // the failing case, for --case
+        std::string failure;
+    };
+
+    int usage(const char* argv0) {
+        fprintf(stderr, "usage: %s [--seed n | --case n] [--cases n] [--seconds s] [--length templates]\n"
+            "    [--dmem bytes] [-j threads] [-o dir] [--block-cache] [--interp]\n"
+            "  --case reruns the one case a failure names\n"
+            "  --block-cache also runs every case with the block cache, which must match\n"
+            "  the pipeline cycle for cycle, --interp on the threaded-code interpreter\n"
+            "  a failing case is minimised and written to dir/iimage.bin, dir/dimage.bin\n"
+            "  and dir/listing.txt\n", argv0);
+        return 2;
+    }
+}
+
+int main(int argc, char** argv) {
+    Config cfg;
+    uint64_t seed = std::random_device()();
+    size_t cases = 100000, threads = std::thread::hardware_concurrency();
+    double seconds = 0;
+    bool replay = false;
+    std::string out = "fuzz-failure";
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) seed = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--cases" && i + 1 < argc) cases = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--case" && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 0);
+            replay = true;
+        }
+        else if (arg == "--seconds" && i + 1 < argc) seconds = strtod(argv[++i], nullptr);
+        else if (arg == "--length" && i + 1 < argc) cfg.templates = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--dmem" && i + 1 < argc) cfg.dsize = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "-j" && i + 1 < argc) threads = strtoull(argv[++i], nullptr, 0);
+        else if (arg == "-o" && i + 1 < argc) out = argv[++i];
+        else if (arg == "--block-cache") cfg.blockCache = true;
+        else if (arg == "--interp") cfg.interp = true;
+        else return usage(argv[0]);
+    }
+    // addresses are built with lui/ori, branch offsets and jr targets stay small
+    if (cfg.dsize < 64 || cfg.dsize > (uint64_t(1) << 32) || cfg.dsize % 4 != 0 || cfg.templates == 0)
+        return usage(argv[0]);
+    if (replay) cases = 1;
+    threads = std::max<size_t>(1, std::min(threads, cases));
+    // case i is generated from first + i, so nearby seeds do not share cases
+    const uint64_t first = replay ? seed : splitmix(seed)();
+    // the report buffers are allocated per case: keep them off mmap
+    mallopt(M_MMAP_THRESHOLD, 8 << 20);
+    mallopt(M_TRIM_THRESHOLD, 64 << 20);
+    std::vector<Worker> workers(threads);
+    for (Worker& w : workers) {
+        w.error_dump.reset(new memfile("error_dump.rpt"));
+        if (w.error_dump->fd < 0) {
+            perror("memfd_create");
+            return 2;
+        }
+    }
+    printf("seed %llu\n", (unsigned long long)seed);
+    const auto start = std::chrono::steady_clock::now();
+    const auto elapsed = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+    std::atomic<bool> stop(false);
+    threadpool pool(threads);
+    for (size_t t = 0; t < threads; ++t) {
+        pool.submit([&, t] {
+            Worker& w = workers[t];
+            SimulatorBase::Status ended;
+            for (size_t i = t; i < cases && !stop.load(std::memory_order_relaxed); i += threads) {
+                if (seconds > 0 && elapsed() >= seconds) break;
+                generator gen(first + i, cfg.dsize);
+                const Case c = gen.make(cfg.templates);
+                ++w.cases;
+                if (c.PC0 + 4 * c.words.size() > cfg.isize) continue;
+                w.instrs += c.words.size();
+                const std::string failure = check(c, cfg, *w.error_dump, ended);
+                w.halted += ended == SimulatorBase::HALTED;
+                w.faulted += ended == SimulatorBase::ERROR;
+                if (failure.empty()) continue;
+                w.failed = first + i;
+                w.failure = failure;
+                stop = true;
+            }
+        });
+    }
+    pool.run();
+    const double t = elapsed();
+    size_t n = 0, instrs = 0, halted = 0, faulted = 0;
+    const Worker* failed = nullptr;
+    for (const Worker& w : workers) {
+        n += w.cases;
+        instrs += w.instrs;
+        halted += w.halted;
+        faulted += w.faulted;
+        if (!w.failure.empty() && (failed == nullptr || w.failed < failed->failed)) failed = &w;
+    }
+    printf("%zu cases (%zu halted, %zu address errors, %zu skipped), %zu instructions generated\n",
+        n, halted, faulted, n - halted - faulted, instrs);
+    if (failed == nullptr) {
+        printf("no failures in %.2f s, %.0f cases/s on %zu threads\n", t, t > 0 ? n / t : 0.0, threads);
+        return 0;
+    }
+    printf("case %llu failed: %s\n", (unsigned long long)failed->failed, failed->failure.c_str());
+    generator gen(failed->failed, cfg.dsize);
+    const Case m = minimise(gen.make(cfg.templates), cfg, *failed->error_dump);
+    SimulatorBase::Status ended;
+    const std::string left = check(m, cfg, *failed->error_dump, ended);
+    printf("minimised to %zu instructions, %zu data words: %s\n", m.words.size(), m.data.size(), left.c_str());
+    list(stdout, m);
+    mkdir(out.c_str(), 0755);
+    FILE* f = fopen((out + "/listing.txt").c_str(), "w");
+    if (f != nullptr) {
+        fprintf(f, "case %llu, minimised: %s\n", (unsigned long long)failed->failed, left.c_str());
+        list(f, m);
+        fclose(f);
+    }
+    if (f == nullptr || !writeImage(out + "/iimage.bin", m.PC0, m.words) ||
+        !writeImage(out + "/dimage.bin", m.SP, m.data)) {
+        perror(out.c_str());
+        return 2;
+    }
+    printf("images in %s/\n", out.c_str());
+    return 1;
+}
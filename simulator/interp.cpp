@@ -0,0 +1,448 @@
+#include "interp.hpp"
+#include <algorithm>
+#include "errors.hpp"
+
+bool interp::loadImages(const char* iimage, const char* dimage) {
+    uint32_t SP;
+    if (!mem.LoadInstr(iimage) || !mem.LoadData(SP, dimage)) return false;
+    reg.setReg(29, SP);
+    return true;
+}
+
+void interp::loadImages(const uint32_t PC0, const uint32_t* instr, const size_t icount,
+    const uint32_t SP, const uint32_t* data, const size_t dcount)
+{
+    mem.LoadInstr(PC0, instr, icount);
+    mem.LoadData(data, dcount);
+    reg.setReg(29, SP);
+}
+
+bool interp::openReports(const char* snapshot_path, const char* error_dump_path, const bool direct) {
+    return snapshot.open(snapshot_path, direct) && error_dump.open(error_dump_path, direct);
+}
+
+// the registers at close, as Simulator<TraceErrorsOnly>::closeReports writes them
+bool interp::closeReports() {
+    if (snapshot.isOpen()) {
+        uint32_t regs[34];
+        for (int i = 0; i < 32; ++i) regs[i] = reg.getReg(i);
+        regs[32] = reg.getHI();
+        regs[33] = reg.getLO();
+        tracer_.putRegs(regs, cycle_);
+        TraceRecord r;
+        r.kind = TraceRecord::HEAD;
+        r.cycle = cycle_;
+        r.full = true;
+        r.c.PC = mem.getPC();
+        tracer_.put(r);
+    }
+    const bool wrote = snapshot.close();
+    return error_dump.close() && wrote;
+}
+
+/**
+* Errors
+* raised ahead of time, EX errors a cycle after ID and WB errors three, and
+* written in cycle order as the pipeline dumps them
+*/
+
+void interp::raise(const size_t now, const size_t at, const uint32_t err) {
+    // nothing pending: every cycle up to now is complete
+    if (npend_ == 0) errNext_ = now + 1;
+    uint32_t& e = pend_[at & 15];
+    if (e == 0) ++npend_;
+    e |= err;
+}
+
+// the errors raised up to cycle upTo
+void interp::dumpErrors(const size_t upTo) {
+    for (; npend_ != 0 && errNext_ <= upTo; ++errNext_) {
+        uint32_t& e = pend_[errNext_ & 15];
+        if (e == 0) continue;
+        if (error_dump.isOpen()) {
+            TraceRecord r;
+            r.kind = TraceRecord::ERRORS;
+            r.cycle = errNext_ + 1;
+            r.err = e;
+            tracer_.put(r);
+        }
+        e = 0;
+        --npend_;
+    }
+}
+
+// the run ends in cycle, its stages last ran in cycle last: the
+// instructions that had not reached WB by then lose what they are behind on
+void interp::finish(const SimulatorBase::Status status, const size_t last, const size_t cycle, const uint32_t PC) {
+    for (size_t i = 0; i < 4 && i < nundo_; ++i) {
+        const Undo& u = undo_[(nundo_ - 1 - i) & 3];
+        if (u.cycle + 3 <= last) break;
+        if (u.dest != 0) reg.setReg(u.dest, u.old);
+        retired_ -= u.retires;
+        if (u.cycle + 2 <= last) continue;
+        switch (u.width) {
+            case 4: { mem.saveWord(u.addr, u.memOld); break; }
+            case 2: { mem.saveHalfWord(u.addr, u.memOld); break; }
+            case 1: { mem.saveByte(u.addr, u.memOld); break; }
+        }
+        if (u.cycle + 1 <= last) continue;
+        if (u.hilo) reg.restoreHILO(u.HI, u.LO, u.lock);
+        events_.fwdExDmRs -= (u.fwd & NOTE_FWD_EXDM_RS) != 0;
+        events_.fwdDmWbRs -= (u.fwd & NOTE_FWD_DMWB_RS) != 0;
+        events_.fwdExDmRt -= (u.fwd & NOTE_FWD_EXDM_RT) != 0;
+        events_.fwdDmWbRt -= (u.fwd & NOTE_FWD_DMWB_RT) != 0;
+    }
+    if (cycle > 0) dumpErrors(cycle - 1);
+    cycle_ = cycle;
+    mem.setPC(PC);
+    status_ = status;
+}
+
+/**
+* Translation
+* a block runs from its entry slot through the next branch or jump, or to
+* the end of the image. Instruction memory is not writable from the data
+* side, so a translation never goes stale
+*/
+
+uint32_t interp::translate(const uint32_t slot, const void* const* labels) {
+    const uint32_t first = code_.size() + 1;
+    for (uint32_t s = slot;; ++s) {
+        Insn i = {};
+        if (s > mem.getInstrCount()) {
+            i.op = labels[IR::OP_COUNT + 1];
+            code_.push_back(i);
+            break;
+        }
+        const IR::Decoded& d = mem.getDecoded(s);
+        i.op = labels[d.op];
+        i.slot = s;
+        i.rs = d.rs;
+        i.rt = d.rt;
+        i.dest = d.type == 'R' ? d.rd : d.type == 'I' ? d.rt : 31;
+        i.shamt = d.shamt;
+        i.imm = d.imm;
+        i.src = d.src;
+        i.load = d.load;
+        i.wmask = d.dest;
+        i.srcRs = d.srcRs;
+        i.srcRt = d.srcRt;
+        i.halt = d.op == IR::OP_HALT;
+        i.retires = !i.halt;
+        const bool branch = d.op == IR::OP_BEQ || d.op == IR::OP_BNE || d.op == IR::OP_BGTZ;
+        if (branch) {
+            // bgtz reads no rt, but a load in DM still stalls it on the rt field
+            const uint32_t rt = d.op != IR::OP_BGTZ ? d.rtMask : 0;
+            i.imm = d.imm << 2;
+            i.bEX = d.rsMask | rt;
+            i.bDM = d.rsMask | d.rtMask;
+            i.idRs = d.rsMask;
+            i.idRt = rt;
+        } else if (d.op == IR::OP_JR) {
+            i.bEX = i.bDM = i.idRs = d.rsMask;
+        } else if (d.type == 'J') {
+            i.imm = d.C << 2;
+        }
+        code_.push_back(i);
+        if (branch || d.op == IR::OP_JR || d.type == 'J') break;
+    }
+    entry_[slot] = first;
+    ++blocks_;
+    return first;
+}
+
+/**
+* Interpreter
+* every handler takes its instruction through ID in the shadow, stalling
+* it as the pipeline would, then does all of its work at once
+*/
+
+// the two latches ahead of ID by what a load and any instruction write,
+// and HALT in the last four
+#define SHIFT(ld, w, h) do { \
+        l2load = l1load; \
+        l2w = l1w; \
+        l1load = (ld); \
+        l1w = (w); \
+        halts = (halts << 1 | (h)) & 0xf; \
+    } while (0)
+// a cycle starting past the last one ends the run
+#define TOP() if (cycle > last) goto stop
+#define STALLS() \
+    while ((l1load & ip->src) | (l1w & ip->bEX) | (l2load & ip->bDM)) { \
+        TOP(); \
+        if (l1load & ip->src) ++events_.loadUseStalls; \
+        else ++events_.branchStalls; \
+        SHIFT(0, 0, 0); \
+        pcAfter = pc + 4; \
+        ++cycle; \
+    } \
+    TOP()
+// through ID in cycle now, forwarding counted where the pipeline does
+#define ISSUE() \
+    STALLS(); \
+    now = cycle++; \
+    if (npend_ != 0) dumpErrors(now - 1); \
+    u = &undo_[nundo_++ & 3]; \
+    u->cycle = now; \
+    u->dest = u->width = u->fwd = 0; \
+    u->hilo = false; \
+    u->retires = ip->retires; \
+    retired_ += ip->retires; \
+    if ((ip->idRs | ip->idRt) & l2w) { \
+        events_.fwdExDmRs += (ip->idRs & l2w) != 0; \
+        events_.fwdExDmRt += (ip->idRt & l2w) != 0; \
+    } \
+    if ((ip->srcRs | ip->srcRt) & (l1w | l2w)) { \
+        if (ip->srcRs & l1w) u->fwd |= NOTE_FWD_EXDM_RS; \
+        else if (ip->srcRs & l2w) u->fwd |= NOTE_FWD_DMWB_RS; \
+        if (ip->srcRt & l1w) u->fwd |= NOTE_FWD_EXDM_RT; \
+        else if (ip->srcRt & l2w) u->fwd |= NOTE_FWD_DMWB_RT; \
+        events_.fwdExDmRs += (u->fwd & NOTE_FWD_EXDM_RS) != 0; \
+        events_.fwdDmWbRs += (u->fwd & NOTE_FWD_DMWB_RS) != 0; \
+        events_.fwdExDmRt += (u->fwd & NOTE_FWD_EXDM_RT) != 0; \
+        events_.fwdDmWbRt += (u->fwd & NOTE_FWD_DMWB_RT) != 0; \
+    } \
+    SHIFT(ip->load, ip->wmask, ip->halt); \
+    pcAfter = pc + 8
+// IF was flushed in the cycle just passed and fetches pc in the next
+#define FLUSH() \
+    pcAfter = pc; \
+    TOP(); \
+    SHIFT(0, 0, 0); \
+    pcAfter = pc + 4; \
+    ++cycle
+#define NEXT() \
+    pc += 4; \
+    ++ip; \
+    goto *ip->op
+#define LOOKUP() do { \
+        const uint32_t s = mem.getSlot(pc); \
+        if (s == 0) { \
+            ip = &outside; \
+        } else { \
+            uint32_t e = entry_[s]; \
+            if (e == 0) e = translate(s, labels); \
+            ip = &code_[e - 1]; \
+        } \
+        goto *ip->op; \
+    } while (0)
+#define RS reg.getReg(ip->rs)
+#define RT reg.getReg(ip->rt)
+#define WRITE(v) do { \
+        const uint32_t v_ = (v); \
+        if (ip->dest == 0) { \
+            raise(now, now + 3, ERR_WRITE_REG_ZERO); \
+        } else { \
+            u->dest = ip->dest; \
+            u->old = reg.getReg(ip->dest); \
+            reg.setReg(ip->dest, v_); \
+        } \
+    } while (0)
+#define OVERFLOW(e) do { \
+        if (const uint32_t e_ = (e)) raise(now, now + 1, e_); \
+    } while (0)
+// a halting access is not performed; the first one ends the run after its cycle
+#define FAULT(f) do { \
+        raise(now, now + 2, f); \
+        if (fault_ == SIZE_MAX) { \
+            fault_ = now + 2; \
+            last = std::min(last, fault_); \
+        } \
+    } while (0)
+#define SAVEHILO() do { \
+        u->hilo = true; \
+        u->HI = reg.getHI(); \
+        u->LO = reg.getLO(); \
+        u->lock = reg.getHILOlock(); \
+    } while (0)
+#define ALU(L, v) L: { ISSUE(); WRITE(v); NEXT(); }
+#define LOAD(L, size, v) L: { \
+        ISSUE(); \
+        const uint32_t a = RS, addr = a + ip->imm; \
+        OVERFLOW(isOverflow(a, ip->imm, addr)); \
+        if (const uint32_t f = checkAccess(mem, addr, size)) FAULT(f); \
+        else WRITE(v); \
+        NEXT(); \
+    }
+#define STORE(L, size, load, save) L: { \
+        ISSUE(); \
+        const uint32_t a = RS, addr = a + ip->imm; \
+        OVERFLOW(isOverflow(a, ip->imm, addr)); \
+        if (const uint32_t f = checkAccess(mem, addr, size)) { \
+            FAULT(f); \
+        } else { \
+            u->width = size; \
+            u->addr = addr; \
+            u->memOld = mem.load(addr); \
+            mem.save(addr, RT); \
+        } \
+        NEXT(); \
+    }
+#define BRANCH(L, taken) L: { \
+        ISSUE(); \
+        if (taken) { \
+            ++events_.branchFlushes; \
+            pc += 4 + ip->imm; \
+            FLUSH(); \
+        } else { \
+            pc += 4; \
+        } \
+        LOOKUP(); \
+    }
+
+SimulatorBase::Status interp::run() {
+    // in IR::Op order, then a PC outside the image and the end of the image
+    static const void* const labels[] = {
+        &&L_NONE, &&L_NOP,
+        &&L_ADD, &&L_ADDU, &&L_SUB, &&L_AND, &&L_OR, &&L_XOR, &&L_NOR, &&L_NAND, &&L_SLT,
+        &&L_SLL, &&L_SRL, &&L_SRA, &&L_JR, &&L_MULT, &&L_MULTU, &&L_MFHI, &&L_MFLO,
+        &&L_J, &&L_JAL, &&L_HALT,
+        &&L_ADDI, &&L_ADDIU, &&L_LW, &&L_LH, &&L_LHU, &&L_LB, &&L_LBU, &&L_SW, &&L_SH, &&L_SB,
+        &&L_LUI, &&L_ANDI, &&L_ORI, &&L_NORI, &&L_SLTI, &&L_BEQ, &&L_BNE, &&L_BGTZ,
+        &&L_RNONE,
+        &&L_OUTSIDE, &&L_END
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == IR::OP_COUNT + 2, "one handler per Op");
+    if (status_ != SimulatorBase::RUNNING) return status_;
+    entry_.assign(mem.getInstrCount() + 1, 0);
+    code_.reserve(mem.getInstrCount() + 16);
+    // fetched from outside the image: a bubble that still takes its cycle in ID
+    Insn outside = {};
+    outside.op = labels[IR::OP_COUNT];
+    uint32_t l1load = 0, l1w = 0, l2load = 0, l2w = 0, halts = 0;
+    size_t cycle = 0, now = 0, last = limit_;
+    uint32_t pc = mem.getPC(), pcAfter = pc;
+    const Insn* ip;
+    Undo* u;
+    // cycle 0: a bubble in ID while IF fetches the first instruction
+    pcAfter = pc + 4;
+    cycle = 1;
+    LOOKUP();
+
+    L_NONE: {
+        STALLS();
+        finish(SimulatorBase::ILLEGAL, cycle, cycle, pc + 4);
+        return status_;
+    }
+    L_NOP: { ISSUE(); NEXT(); }
+    L_ADD: {
+        ISSUE();
+        const uint32_t a = RS, b = RT, c = a + b;
+        OVERFLOW(isOverflow(a, b, c));
+        WRITE(c);
+        NEXT();
+    }
+    ALU(L_ADDU, RS + RT)
+    L_SUB: {
+        ISSUE();
+        const uint32_t a = RS, b = RT, c = a - b;
+        OVERFLOW(isSubOverflow(a, b, c));
+        WRITE(c);
+        NEXT();
+    }
+    ALU(L_AND, RS & RT)
+    ALU(L_OR, RS | RT)
+    ALU(L_XOR, RS ^ RT)
+    ALU(L_NOR, ~(RS | RT))
+    ALU(L_NAND, ~(RS & RT))
+    ALU(L_SLT, int32_t(RS) < int32_t(RT) ? 1 : 0)
+    ALU(L_SLL, RT << ip->shamt)
+    ALU(L_SRL, RT >> ip->shamt)
+    ALU(L_SRA, uint32_t(int32_t(RT) >> ip->shamt))
+    L_JR: {
+        ISSUE();
+        ++events_.jumpFlushes;
+        pc = RS;
+        FLUSH();
+        LOOKUP();
+    }
+    L_MULT: {
+        ISSUE();
+        SAVEHILO();
+        const uint64_t m = uint64_t(int64_t(int32_t(RS)) * int64_t(int32_t(RT)));
+        if (reg.setHILO(m >> 32, m & 0xffffffff)) raise(now, now + 1, ERR_OVERWRTIE_REG_HI_LO);
+        NEXT();
+    }
+    L_MULTU: {
+        ISSUE();
+        SAVEHILO();
+        const uint64_t m = uint64_t(RS) * uint64_t(RT);
+        if (reg.setHILO(m >> 32, m & 0xffffffff)) raise(now, now + 1, ERR_OVERWRTIE_REG_HI_LO);
+        NEXT();
+    }
+    L_MFHI: {
+        ISSUE();
+        SAVEHILO();
+        WRITE(reg.fetchHI());
+        NEXT();
+    }
+    L_MFLO: {
+        ISSUE();
+        SAVEHILO();
+        WRITE(reg.fetchLO());
+        NEXT();
+    }
+    L_J: {
+        ISSUE();
+        ++events_.jumpFlushes;
+        pc = ((pc + 4) & 0xf0000000) | ip->imm;
+        FLUSH();
+        LOOKUP();
+    }
+    L_JAL: {
+        ISSUE();
+        WRITE(pc + 4);
+        ++events_.jumpFlushes;
+        pc = ((pc + 4) & 0xf0000000) | ip->imm;
+        FLUSH();
+        LOOKUP();
+    }
+    L_HALT: {
+        ISSUE();
+        // HALT in every stage and in IF, none of them stalled
+        if (halts == 0xf && mem.getDecoded(mem.getSlot(pc + 4)).op == IR::OP_HALT) {
+            finish(SimulatorBase::HALTED, now, now, pcAfter);
+            return status_;
+        }
+        NEXT();
+    }
+    L_ADDI: {
+        ISSUE();
+        const uint32_t a = RS, c = a + ip->imm;
+        OVERFLOW(isOverflow(a, ip->imm, c));
+        WRITE(c);
+        NEXT();
+    }
+    ALU(L_ADDIU, RS + ip->imm)
+    LOAD(L_LW, 4, mem.loadWord(addr))
+    LOAD(L_LH, 2, SignExt16(mem.loadHalfWord(addr)))
+    LOAD(L_LHU, 2, mem.loadHalfWord(addr) & 0xffff)
+    LOAD(L_LB, 1, SignExt8(mem.loadByte(addr)))
+    LOAD(L_LBU, 1, mem.loadByte(addr) & 0xff)
+    STORE(L_SW, 4, loadWord, saveWord)
+    STORE(L_SH, 2, loadHalfWord, saveHalfWord)
+    STORE(L_SB, 1, loadByte, saveByte)
+    ALU(L_LUI, ip->imm)
+    ALU(L_ANDI, RS & ip->imm)
+    ALU(L_ORI, RS | ip->imm)
+    ALU(L_NORI, ~(RS | ip->imm))
+    ALU(L_SLTI, int32_t(RS) < int32_t(ip->imm) ? 1 : 0)
+    BRANCH(L_BEQ, RS == RT)
+    BRANCH(L_BNE, RS != RT)
+    BRANCH(L_BGTZ, int32_t(RS) > 0)
+    ALU(L_RNONE, 0)
+    L_OUTSIDE: {
+        ISSUE();
+        pc += 4;
+        LOOKUP();
+    }
+    L_END: { LOOKUP(); }
+
+stop:
+    // a halting access ends the run at the top of the cycle after it,
+    // unless the cycle limit comes first
+    if (fault_ < limit_) finish(SimulatorBase::ERROR, fault_, fault_ + 1, pcAfter);
+    else finish(SimulatorBase::LIMIT, limit_, limit_, pcAfter);
+    return status_;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include "simulator.hpp"
+
+// functional interpreter for reference runs: each basic block of the
+// instruction image is translated once, on first entry, into direct-threaded
+// code whose handlers are reached by computed goto with their operands
+// already extracted. A shadow of the slots in the latches keeps the
+// pipeline's timing, so cycles, counters, error_dump.rpt and the registers
+// at close are those of Simulator<TraceErrorsOnly> on the same images
+class interp {
+public:
+    interp() {}
+    interp(const interp&) = delete;
+    interp& operator=(const interp&) = delete;
+    bool setMemorySize(const uint64_t isize, const uint64_t dsize) { return mem.resize(isize, dsize); }
+    bool loadImages(const char* iimage = "iimage.bin", const char* dimage = "dimage.bin");
+    void loadImages(const uint32_t, const uint32_t*, const size_t,
+        const uint32_t, const uint32_t*, const size_t);
+    // error_dump.rpt, and snapshot.rpt with the registers at close
+    bool openReports(const char* snapshot = "snapshot.rpt",
+        const char* error_dump = "error_dump.rpt", const bool direct = false);
+    // false if a report could not be written in full, errno set
+    bool closeReports();
+    void setCycleLimit(const size_t rhs) { limit_ = rhs; }
+    SimulatorBase::Status run();
+    const size_t getCycle() const { return cycle_; }
+    const size_t getRetired() const { return retired_; }
+    const counters& getCounters() const { return events_; }
+    const SimulatorBase::Status getStatus() const { return status_; }
+    const regfile& getRegfile() const { return reg; }
+    // its PC is the pipeline's fetch PC once the run has ended
+    const memory& getMemory() const { return mem; }
+    const size_t getBlockCount() const { return blocks_; }
+
+private:
+    // one translated instruction
+    struct Insn {
+        const void* op; // handler label in run()
+        uint32_t slot, imm; // imm: as EX uses it, a branch offset in bytes or a jump target
+        uint8_t rs, rt, dest, shamt; // dest: the register the op writes
+        // hazards as ID sees them: load-use sources, branch and jr sources
+        // against the instruction in EX and a load in DM; as a latch, the
+        // register a load writes and the one the instruction writes
+        uint32_t src, bEX, bDM, load, wmask;
+        // forwarding: EX operands, branch and jr operands in ID
+        uint32_t srcRs, srcRt, idRs, idRt;
+        bool halt, retires;
+    };
+    // what one of the last instructions changed: the run can end with it
+    // part way down the pipeline
+    struct Undo {
+        size_t cycle; // through ID
+        uint32_t old, addr, memOld, HI, LO;
+        uint8_t dest, width, fwd; // fwd: NOTE_FWD_* counted for EX
+        bool retires, hilo, lock; // hilo: HI, LO and the lock saved
+    };
+    uint32_t translate(const uint32_t, const void* const*);
+    void raise(const size_t, const size_t, const uint32_t);
+    void dumpErrors(const size_t);
+    void finish(const SimulatorBase::Status, const size_t, const size_t, const uint32_t);
+
+    memory mem;
+    regfile reg;
+    report snapshot, error_dump;
+    tracer tracer_{snapshot, error_dump};
+    std::vector<Insn> code_;
+    std::vector<uint32_t> entry_; // per slot, 1 + index into code_ of its block, 0 if none yet
+    size_t blocks_ = 0;
+    size_t cycle_ = 0, limit_ = 500000, retired_ = 0;
+    size_t fault_ = SIZE_MAX; // cycle of the first halting access in DM
+    counters events_;
+    SimulatorBase::Status status_ = SimulatorBase::RUNNING;
+    // errors by the cycle they are raised in, dumped once no instruction can add to it
+    uint32_t pend_[16] = {};
+    size_t npend_ = 0, errNext_ = 0;
+    Undo undo_[4];
+    size_t nundo_ = 0;
+};
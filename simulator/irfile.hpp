@@ -1,121 +1,160 @@
 #pragma once
-#include <string>
+#include <cstdint>
 
 namespace IR {
-    char getType(const uint32_t rhs) {
-        uint32_t opcode = (rhs >> 26) & 0x3f;
-        switch (opcode) {
-            case 0x00:
-                return 'R';
-            case 0x08: case 0x09: case 0x23: case 0x21: case 0x25: case 0x20:
-            case 0x24: case 0x2B: case 0x29: case 0x28: case 0x0F: case 0x0C:
-            case 0x0D: case 0x0E: case 0x0A: case 0x04: case 0x05: case 0x07:
-                return 'I';
-            case 0x02: case 0x03:
-                return 'J';
-            case 0x3f:
-                return 'S';
-        }
-        return 'F';
-    }
+    // mnemonic id, index into Ops
+    enum Op : uint8_t {
+        OP_NONE, OP_NOP,
+        OP_ADD, OP_ADDU, OP_SUB, OP_AND, OP_OR, OP_XOR, OP_NOR, OP_NAND, OP_SLT,
+        OP_SLL, OP_SRL, OP_SRA, OP_JR, OP_MULT, OP_MULTU, OP_MFHI, OP_MFLO,
+        OP_J, OP_JAL, OP_HALT,
+        OP_ADDI, OP_ADDIU, OP_LW, OP_LH, OP_LHU, OP_LB, OP_LBU, OP_SW, OP_SH, OP_SB,
+        OP_LUI, OP_ANDI, OP_ORI, OP_NORI, OP_SLTI, OP_BEQ, OP_BNE, OP_BGTZ,
+        OP_RNONE, // opcode 0 with an unknown funct: writes 0 to rd
+        OP_COUNT
+    };
 
-    std::string getFunctName(const uint32_t funct) {
-        switch (funct) {
-            case 0x20: return "ADD";
-            case 0x21: return "ADDU";
-            case 0x22: return "SUB";
-            case 0x24: return "AND";
-            case 0x25: return "OR";
-            case 0x26: return "XOR";
-            case 0x27: return "NOR";
-            case 0x28: return "NAND";
-            case 0x2A: return "SLT";
-            case 0x00: return "SLL";
-            case 0x02: return "SRL";
-            case 0x03: return "SRA";
-            case 0x08: return "JR";
-            case 0x18: return "MULT";
-            case 0x19: return "MULTU";
-            case 0x10: return "MFHI";
-            case 0x12: return "MFLO";
-        }
-        return "";
-    }
+    // what the EX stage computes
+    enum Alu : uint8_t {
+        ALU_NONE, ALU_ADD, ALU_SUB, ALU_AND, ALU_OR, ALU_XOR, ALU_NOR, ALU_NAND, ALU_SLT,
+        ALU_SLL, ALU_SRL, ALU_SRA, ALU_MULT, ALU_MULTU, ALU_MFHI, ALU_MFLO, ALU_LUI, ALU_LINK
+    };
 
-    std::string getOpName(const uint32_t instr) {
-        const uint32_t opcode = (instr >> 26) & 0x3f;
-        switch (opcode) {
-            case 0x00: {
-                if ((instr & 0x1FFFFF) == 0) return "NOP";
-                return getFunctName(instr & 0x3f);
-            }
-            case 0x02: return "J";
-            case 0x03: return "JAL";
-            case 0x3f: return "HALT";
-            case 0x08: return "ADDI";
-            case 0x09: return "ADDIU";
-            case 0x23: return "LW";
-            case 0x21: return "LH";
-            case 0x25: return "LHU";
-            case 0x20: return "LB";
-            case 0x24: return "LBU";
-            case 0x2B: return "SW";
-            case 0x29: return "SH";
-            case 0x28: return "SB";
-            case 0x0F: return "LUI";
-            case 0x0C: return "ANDI";
-            case 0x0D: return "ORI";
-            case 0x0E: return "NORI";
-            case 0x0A: return "SLTI";
-            case 0x04: return "BEQ";
-            case 0x05: return "BNE";
-            case 0x07: return "BGTZ";
+    // how the immediate is extended
+    enum Ext : uint8_t { EXT_NONE, EXT_SIGN, EXT_ZERO, EXT_LUI, EXT_TARGET };
+
+    struct OpInfo {
+        const char* name;
+        char type; // 'R', 'I', 'J', 'S', or 'F' for an illegal word
+        uint8_t opcode, funct, alu, ext;
+        bool has_rs, has_rt; // operands the hazard and forwarding logic compares
+        bool writes; // RegWrite after EX
+        bool overflow; // signed overflow is reported
+        uint8_t width; // memory access in bytes, 0 for none
+        bool store, sign; // sign: extend a narrow load
+    };
+
+    // the instruction set, one row per Op
+    constexpr OpInfo Ops[OP_COUNT] = {
+        // name    type opcode funct alu        ext         rs     rt     writes ovf    w  store  sign
+        {"",       'F', 0x00, 0x00, ALU_NONE,  EXT_NONE,   true,  false, false, false, 0, false, false},
+        {"NOP",    'R', 0x00, 0x00, ALU_NONE,  EXT_NONE,   false, false, false, false, 0, false, false},
+        {"ADD",    'R', 0x00, 0x20, ALU_ADD,   EXT_NONE,   true,  true,  true,  true,  0, false, false},
+        {"ADDU",   'R', 0x00, 0x21, ALU_ADD,   EXT_NONE,   true,  true,  true,  false, 0, false, false},
+        {"SUB",    'R', 0x00, 0x22, ALU_SUB,   EXT_NONE,   true,  true,  true,  true,  0, false, false},
+        {"AND",    'R', 0x00, 0x24, ALU_AND,   EXT_NONE,   true,  true,  true,  false, 0, false, false},
+        {"OR",     'R', 0x00, 0x25, ALU_OR,    EXT_NONE,   true,  true,  true,  false, 0, false, false},
+        {"XOR",    'R', 0x00, 0x26, ALU_XOR,   EXT_NONE,   true,  true,  true,  false, 0, false, false},
+        {"NOR",    'R', 0x00, 0x27, ALU_NOR,   EXT_NONE,   true,  true,  true,  false, 0, false, false},
+        {"NAND",   'R', 0x00, 0x28, ALU_NAND,  EXT_NONE,   true,  true,  true,  false, 0, false, false},
+        {"SLT",    'R', 0x00, 0x2A, ALU_SLT,   EXT_NONE,   true,  true,  true,  false, 0, false, false},
+        {"SLL",    'R', 0x00, 0x00, ALU_SLL,   EXT_NONE,   false, true,  true,  false, 0, false, false},
+        {"SRL",    'R', 0x00, 0x02, ALU_SRL,   EXT_NONE,   false, true,  true,  false, 0, false, false},
+        {"SRA",    'R', 0x00, 0x03, ALU_SRA,   EXT_NONE,   false, true,  true,  false, 0, false, false},
+        {"JR",     'R', 0x00, 0x08, ALU_NONE,  EXT_NONE,   false, false, false, false, 0, false, false},
+        {"MULT",   'R', 0x00, 0x18, ALU_MULT,  EXT_NONE,   true,  true,  false, false, 0, false, false},
+        {"MULTU",  'R', 0x00, 0x19, ALU_MULTU, EXT_NONE,   true,  true,  false, false, 0, false, false},
+        {"MFHI",   'R', 0x00, 0x10, ALU_MFHI,  EXT_NONE,   false, false, true,  false, 0, false, false},
+        {"MFLO",   'R', 0x00, 0x12, ALU_MFLO,  EXT_NONE,   false, false, true,  false, 0, false, false},
+        {"J",      'J', 0x02, 0x00, ALU_NONE,  EXT_TARGET, false, false, false, false, 0, false, false},
+        {"JAL",    'J', 0x03, 0x00, ALU_LINK,  EXT_TARGET, false, false, true,  false, 0, false, false},
+        {"HALT",   'S', 0x3F, 0x00, ALU_NONE,  EXT_TARGET, false, false, false, false, 0, false, false},
+        {"ADDI",   'I', 0x08, 0x00, ALU_ADD,   EXT_SIGN,   true,  false, true,  true,  0, false, false},
+        {"ADDIU",  'I', 0x09, 0x00, ALU_ADD,   EXT_SIGN,   true,  false, true,  false, 0, false, false},
+        {"LW",     'I', 0x23, 0x00, ALU_ADD,   EXT_SIGN,   true,  false, true,  true,  4, false, false},
+        {"LH",     'I', 0x21, 0x00, ALU_ADD,   EXT_SIGN,   true,  false, true,  true,  2, false, true},
+        {"LHU",    'I', 0x25, 0x00, ALU_ADD,   EXT_SIGN,   true,  false, true,  true,  2, false, false},
+        {"LB",     'I', 0x20, 0x00, ALU_ADD,   EXT_SIGN,   true,  false, true,  true,  1, false, true},
+        {"LBU",    'I', 0x24, 0x00, ALU_ADD,   EXT_SIGN,   true,  false, true,  true,  1, false, false},
+        {"SW",     'I', 0x2B, 0x00, ALU_ADD,   EXT_SIGN,   true,  true,  false, true,  4, true,  false},
+        {"SH",     'I', 0x29, 0x00, ALU_ADD,   EXT_SIGN,   true,  true,  false, true,  2, true,  false},
+        {"SB",     'I', 0x28, 0x00, ALU_ADD,   EXT_SIGN,   true,  true,  false, true,  1, true,  false},
+        {"LUI",    'I', 0x0F, 0x00, ALU_LUI,   EXT_LUI,    false, false, true,  false, 0, false, false},
+        {"ANDI",   'I', 0x0C, 0x00, ALU_AND,   EXT_ZERO,   true,  false, true,  false, 0, false, false},
+        {"ORI",    'I', 0x0D, 0x00, ALU_OR,    EXT_ZERO,   true,  false, true,  false, 0, false, false},
+        {"NORI",   'I', 0x0E, 0x00, ALU_NOR,   EXT_ZERO,   true,  false, true,  false, 0, false, false},
+        {"SLTI",   'I', 0x0A, 0x00, ALU_SLT,   EXT_SIGN,   true,  false, true,  false, 0, false, false},
+        {"BEQ",    'I', 0x04, 0x00, ALU_NONE,  EXT_SIGN,   false, false, false, false, 0, false, false},
+        {"BNE",    'I', 0x05, 0x00, ALU_NONE,  EXT_SIGN,   false, false, false, false, 0, false, false},
+        {"BGTZ",   'I', 0x07, 0x00, ALU_NONE,  EXT_SIGN,   false, false, false, false, 0, false, false},
+        {"",       'R', 0x00, 0x00, ALU_NONE,  EXT_NONE,   true,  true,  true,  false, 0, false, false}
+    };
+
+    // opcode or funct to Op, built from the table
+    struct OpMap { uint8_t op[64]; };
+
+    constexpr OpMap makeOpMap(const bool functs) {
+        OpMap m = {};
+        for (int i = 0; i < 64; ++i) m.op[i] = functs ? OP_RNONE : OP_NONE;
+        for (int i = 0; i < OP_COUNT; ++i) {
+            if (i == OP_NOP || i == OP_RNONE || Ops[i].type == 'F') continue;
+            if (functs && Ops[i].type == 'R') m.op[Ops[i].funct] = i;
+            if (!functs && Ops[i].type != 'R') m.op[Ops[i].opcode] = i;
         }
-        return "";
+        return m;
     }
 
-    bool isMemRead(const uint32_t instr) {
+    constexpr OpMap OpcodeOps = makeOpMap(false), FunctOps = makeOpMap(true);
+
+    // predecoded instruction, built once per image word
+    struct Decoded {
+        uint32_t instr = 0,
+            C = 0, // raw immediate (16-bit) or target (26-bit)
+            imm = 0, // immediate extended as the opcode consumes it
+            // register masks, $0 excluded
+            src = 0, dest = 0, // operands the hazard logic compares, register written
+            srcRs = 0, srcRt = 0, // src split by operand
+            rsMask = 0, rtMask = 0, // the rs and rt fields whether read or not
+            load = 0; // dest of a load, 0 otherwise
+        uint8_t opcode = 0, funct = 0, rs = 0, rt = 0, rd = 0, shamt = 0;
+        uint8_t op = OP_NOP;
+        char type = 'R';
+        bool MemRead = false, has_rs = false, has_rt = false;
+    };
+
+    inline uint8_t getOp(const uint32_t instr) {
         const uint32_t opcode = (instr >> 26) & 0x3f;
-        switch (opcode) {
-            // lw, lh, lhu, lb, lbu
-            case 0x23: case 0x21: case 0x25: case 0x20: case 0x24: {
-                return true;
-            }
-        }
-        return false;
+        if (opcode != 0x00) return OpcodeOps.op[opcode];
+        return (instr & 0x1FFFFF) == 0 ? OP_NOP : FunctOps.op[instr & 0x3f];
     }
 
-    bool has_rs(const uint32_t instr) {
-        const uint32_t opcode = (instr >> 26) & 0x3f;
-        if (opcode == 0x00) {
-            const uint32_t funct = instr & 0x3f;
-            switch (funct) {
-                // sll (NOP), srl, sra, jr, mfhi, mflo
-                case 0x00: case 0x02: case 0x03: case 0x08: case 0x10: case 0x12: return false;
-                default: return true;
-            }
-        }
-        // lui, j, jal, halt, beq, bne, bgtz
-        else if (opcode == 0x0F || opcode == 0x02 || opcode == 0x03 || opcode == 0x3F ||
-            opcode == 0x04 || opcode == 0x05 || opcode == 0x07)
-            return false;
-        return true;
+    inline const char* getOpName(const uint32_t instr) {
+        return Ops[getOp(instr)].name;
     }
 
-    bool has_rt(const uint32_t instr) {
-        const uint32_t opcode = (instr >> 26) & 0x3f;
-        if (opcode == 0x00) {
-            if ((instr & 0x1FFFFF) == 0) return false; // NOP
-            const uint32_t funct = instr & 0x3f;
-            switch (funct) {
-                // jr, mfhi, mflo
-                case 0x08: case 0x10: case 0x12: return false;
-                default: return true;
+    inline Decoded decode(const uint32_t instr) {
+        Decoded d;
+        d.instr = instr;
+        d.opcode = (instr >> 26) & 0x3f;
+        d.rs = (instr >> 21) & 0x1f;
+        d.rt = (instr >> 16) & 0x1f;
+        d.rd = (instr >> 11) & 0x1f;
+        d.shamt = (instr >> 6) & 0x1f;
+        d.funct = instr & 0x3f;
+        d.op = getOp(instr);
+        const OpInfo& info = Ops[d.op];
+        d.type = info.type;
+        d.MemRead = info.width != 0 && !info.store;
+        d.has_rs = info.has_rs;
+        d.has_rt = info.has_rt;
+        d.src = (d.has_rs ? 1u << d.rs : 0) | (d.has_rt ? 1u << d.rt : 0);
+        if (info.writes) d.dest = 1u << (d.type == 'R' ? d.rd : d.type == 'I' ? d.rt : 31);
+        switch (info.ext) {
+            case EXT_SIGN: case EXT_ZERO: case EXT_LUI: {
+                d.C = instr & 0xffff;
+                d.imm = info.ext == EXT_LUI ? d.C << 16 :
+                    info.ext == EXT_ZERO || d.C >> 15 == 0x0 ? d.C : (d.C | 0xffff0000);
+                break;
             }
+            case EXT_TARGET: { d.C = d.imm = instr & 0x3ffffff; break; }
         }
-        // sw, sh, sb
-        else if (opcode == 0x2B || opcode == 0x29 || opcode == 0x28)
-            return true;
-        return false;
+        d.rsMask = (1u << d.rs) & ~1u;
+        d.rtMask = (1u << d.rt) & ~1u;
+        d.srcRs = d.has_rs ? d.rsMask : 0;
+        d.srcRt = d.has_rt ? d.rtMask : 0;
+        d.src &= ~1u;
+        d.dest &= ~1u;
+        d.load = d.MemRead ? d.dest : 0;
+        return d;
     }
 }
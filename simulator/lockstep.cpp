@@ -0,0 +1,639 @@
+#include "lockstep.hpp"
+#include <algorithm>
+#include "errors.hpp"
+
+template <class Trace>
+lockstep<Trace>::lockstep(const lockstep& parent, std::vector<Result>* results) :
+    imem_(parent.imem_), dsize_(parent.dsize_), PC_(parent.PC_), cur_(parent.cur_),
+    stall(parent.stall), flush(parent.flush), HILOlock_(parent.HILOlock_), full_(false),
+    cycle_(parent.cycle_), limit_(parent.limit_), retired_(parent.retired_), results_(results)
+{
+    std::copy(parent.IF_ID, parent.IF_ID + 2, IF_ID);
+    std::copy(parent.ID_EX, parent.ID_EX + 2, ID_EX);
+    std::copy(parent.EX_MEM, parent.EX_MEM + 2, EX_MEM);
+    std::copy(parent.MEM_WB, parent.MEM_WB + 2, MEM_WB);
+}
+
+template <class Trace>
+bool lockstep<Trace>::setMemorySize(const uint64_t isize, const uint64_t dsize) {
+    if (!lanes_.empty() || !imem_->resize(isize, dsize)) return false;
+    dsize_ = dsize;
+    return true;
+}
+
+template <class Trace>
+bool lockstep<Trace>::loadInstr(const char* iimage) {
+    if (!lanes_.empty() || !imem_->LoadInstr(iimage)) return false;
+    PC_ = imem_->getPC();
+    return true;
+}
+
+template <class Trace>
+bool lockstep<Trace>::addLane(const char* dimage, const char* snapshot, const char* error_dump, const bool direct) {
+    std::unique_ptr<Lane> lane(new Lane(results_->size()));
+    uint32_t SP;
+    // a lane keeps data only, the instructions are imem_'s
+    if (!lane->mem.resize(4, dsize_) || !lane->mem.LoadData(SP, dimage)) return false;
+    if (Trace::errors && (!lane->snapshot.open(snapshot, direct) ||
+        !lane->error_dump.open(error_dump, direct))) return false;
+    const size_t l = lanes_.size();
+    lanes_.push_back(std::move(lane));
+    columns(*this, *this, [](auto& c, auto&) { c.push_back(0); });
+    reg_[29][l] = SP;
+    results_->push_back(Result());
+    return true;
+}
+
+template <class Trace>
+size_t lockstep<Trace>::run() {
+    if (lanes_.empty()) return 0;
+    std::vector<std::unique_ptr<lockstep>> pending;
+    size_t groups = 1;
+    while (step(pending)) {}
+    // a split group leaves mid-cycle, before the halt and limit checks
+    while (!pending.empty()) {
+        std::unique_ptr<lockstep> g = std::move(pending.back());
+        pending.pop_back();
+        ++groups;
+        if (g->endCycle()) while (g->step(pending)) {}
+    }
+    return groups;
+}
+
+// Simulator::step over the lanes
+template <class Trace>
+bool lockstep<Trace>::step(std::vector<std::unique_ptr<lockstep>>& pending) {
+    // a lane moved in by removeLane has been visited already
+    for (size_t l = lanes_.size(); l-- > 0;) {
+        if (err_[l] == 0) continue;
+        if (Trace::errors) {
+            TraceRecord r;
+            r.kind = TraceRecord::ERRORS;
+            r.cycle = cycle_;
+            r.err = err_[l];
+            lanes_[l]->out.put(r);
+        }
+        if (err_[l] & HALT) finish(l, SimulatorBase::ERROR);
+    }
+    if (lanes_.empty()) return false;
+    const size_t n = lanes_.size();
+    if (Trace::snapshot) {
+        recs_.resize(n);
+        for (size_t l = 0; l < n; ++l) traceRegs(l);
+    }
+    full_ = false;
+    std::fill(err_.begin(), err_.end(), 0);
+    uint32_t err = 0;
+    err |= WB();
+    err |= MEM();
+    err |= EX();
+    const uint32_t instr = imem_->getDecoded(imem_->getSlot(PC_)).instr;
+    err |= ID();
+    if (err & ERR_ILLEGAL) {
+        if (Trace::snapshot) {
+            for (size_t l = 0; l < n; ++l) {
+                recs_[l].kind = TraceRecord::HEAD;
+                lanes_[l]->out.put(recs_[l]);
+            }
+        }
+        finishAll(SimulatorBase::ILLEGAL);
+        return false;
+    }
+    IF();
+    cur_ ^= 1;
+    if (Trace::snapshot) {
+        for (size_t l = 0; l < n; ++l) {
+            TraceRecord& r = recs_[l];
+            r.kind = TraceRecord::CYCLE;
+            r.c.instr = instr;
+            std::copy(stages_, stages_ + 5, r.stages);
+            // a lane leaving the group fetched on its own side of the branch
+            if (branch_ == BRANCH_COND && bool(taken_[l]) != follow_)
+                r.stages[0].note = taken_[l] ? NOTE_FLUSHED : 0;
+            lanes_[l]->out.put(r);
+        }
+    }
+    for (size_t l = 0; l < n; ++l) err_[l] |= err;
+    if (branch_ != BRANCH_NONE) split(pending);
+    return endCycle();
+}
+
+template <class Trace>
+bool lockstep<Trace>::endCycle() {
+    if (halted()) {
+        finishAll(SimulatorBase::HALTED);
+        return false;
+    }
+    if (cycle_ == limit_) {
+        finishAll(SimulatorBase::LIMIT);
+        return false;
+    }
+    ++cycle_;
+    return true;
+}
+
+// lanes that resolved this cycle's branch or jr differently leave in new
+// groups, with the state IF would have left on their side
+template <class Trace>
+void lockstep<Trace>::split(std::vector<std::unique_ptr<lockstep>>& pending) {
+    if (branch_ == BRANCH_COND) {
+        std::unique_ptr<lockstep> child;
+        for (size_t l = lanes_.size(); l-- > 0;) {
+            if (bool(taken_[l]) == follow_) continue;
+            if (!child) {
+                child.reset(new lockstep(*this, results_));
+                if (follow_) {
+                    child->PC_ = idPC_ + 4;
+                    child->IF_ID[cur_].slot = imem_->getSlot(idPC_);
+                } else {
+                    child->PC_ = target_;
+                    child->IF_ID[cur_].slot = 0;
+                }
+            }
+            moveLane(l, *child);
+        }
+        if (child) pending.push_back(std::move(child));
+        return;
+    }
+    // one group per jr target
+    for (;;) {
+        std::unique_ptr<lockstep> child;
+        for (size_t l = lanes_.size(); l-- > 0;) {
+            const uint32_t target = rs_[cur_][l];
+            if (target == PC_) continue;
+            if (!child) {
+                child.reset(new lockstep(*this, results_));
+                child->PC_ = target;
+            } else if (target != child->PC_) {
+                continue;
+            }
+            moveLane(l, *child);
+        }
+        if (!child) return;
+        pending.push_back(std::move(child));
+    }
+}
+
+// HALT in IF and in every stage of the cycle just run
+template <class Trace>
+bool lockstep<Trace>::halted() const {
+    const memory& m = *imem_;
+    return m.getDecoded(IF_ID[cur_].slot).op == IR::OP_HALT &&
+        m.getDecoded(ID_EX[cur_].slot).op == IR::OP_HALT &&
+        m.getDecoded(EX_MEM[cur_].slot).op == IR::OP_HALT &&
+        m.getDecoded(MEM_WB[cur_].slot).op == IR::OP_HALT &&
+        m.getDecoded(MEM_WB[cur_ ^ 1].slot).op == IR::OP_HALT;
+}
+
+/**
+* Lanes
+*/
+
+template <class Trace>
+template <class F>
+void lockstep<Trace>::columns(lockstep& a, lockstep& b, F&& f) {
+    for (int i = 0; i < 32; ++i) f(a.reg_[i], b.reg_[i]);
+    f(a.HI_, b.HI_);
+    f(a.LO_, b.LO_);
+    for (int k = 0; k < 2; ++k) {
+        f(a.rs_[k], b.rs_[k]);
+        f(a.rt_[k], b.rt_[k]);
+        f(a.alu_[k], b.alu_[k]);
+        f(a.addr_[k], b.addr_[k]);
+        f(a.wb_[k], b.wb_[k]);
+        f(a.hilo_[k], b.hilo_[k]);
+        f(a.print_[k], b.print_[k]);
+    }
+    f(a.err_, b.err_);
+    f(a.taken_, b.taken_);
+}
+
+// the last lane takes the place of lane l
+template <class Trace>
+void lockstep<Trace>::removeLane(const size_t l) {
+    columns(*this, *this, [l](auto& c, auto&) {
+        c[l] = c.back();
+        c.pop_back();
+    });
+    lanes_[l] = std::move(lanes_.back());
+    lanes_.pop_back();
+}
+
+template <class Trace>
+void lockstep<Trace>::moveLane(const size_t l, lockstep& to) {
+    columns(to, *this, [l](auto& dst, auto& src) { dst.push_back(src[l]); });
+    to.lanes_.push_back(std::move(lanes_[l]));
+    removeLane(l);
+}
+
+template <class Trace>
+void lockstep<Trace>::finish(const size_t l, const SimulatorBase::Status status) {
+    Lane& lane = *lanes_[l];
+    Result& r = (*results_)[lane.id];
+    r.status = status;
+    r.cycles = cycle_;
+    r.retired = retired_;
+    if (Trace::errors) {
+        // the registers at close, as Simulator::closeReports writes them
+        if (!Trace::snapshot) {
+            uint32_t regs[34];
+            for (int i = 0; i < 32; ++i) regs[i] = reg_[i][l];
+            regs[32] = HI_[l];
+            regs[33] = LO_[l];
+            lane.out.putRegs(regs, cycle_);
+            TraceRecord rec;
+            rec.kind = TraceRecord::HEAD;
+            rec.cycle = cycle_;
+            rec.full = true;
+            rec.c.PC = PC_;
+            lane.out.put(rec);
+        }
+        const bool wrote = lane.snapshot.close();
+        r.written = lane.error_dump.close() && wrote;
+    }
+    removeLane(l);
+}
+
+template <class Trace>
+void lockstep<Trace>::finishAll(const SimulatorBase::Status status) {
+    for (size_t l = lanes_.size(); l-- > 0;) finish(l, status);
+}
+
+/**
+* Reports
+*/
+
+template <class Trace>
+void lockstep<Trace>::traceRegs(const size_t l) {
+    TraceRecord& r = recs_[l];
+    r.cycle = cycle_;
+    r.full = full_;
+    if (full_) {
+        uint32_t regs[34];
+        for (int i = 0; i < 32; ++i) regs[i] = reg_[i][l];
+        regs[32] = HI_[l];
+        regs[33] = LO_[l];
+        lanes_[l]->out.putRegs(regs, cycle_);
+    } else {
+        r.dest = print_[cur_ ^ 1][l] ? MEM_WB[cur_ ^ 1].WriteDest : 0;
+        r.c.value = wb_[cur_ ^ 1][l];
+        r.hilo = hilo_[cur_][l];
+        r.c.HI = HI_[l];
+        r.c.LO = LO_[l];
+    }
+    r.c.PC = PC_;
+}
+
+/**
+* Five Stages
+* Simulator's stages with the data path a loop over the lanes; errors a
+* lane raises go to err_, those of the whole group are returned
+*/
+
+template <class Trace>
+uint32_t lockstep<Trace>::WB() {
+    const MEMWB_Buffer& in = MEM_WB[cur_];
+    const uint8_t op = imem_->getDecoded(in.slot).op;
+    if (Trace::snapshot) stages_[4] = StageLabel(op);
+    if (in.slot != 0 && op != IR::OP_HALT) ++retired_;
+    const size_t n = lanes_.size();
+    const uint32_t* data = wb_[cur_].data();
+    uint8_t* print = print_[cur_].data();
+    if (!in.RegWrite || in.WriteDest == 0) {
+        if (Trace::snapshot) std::fill(print, print + n, 0);
+        return in.RegWrite ? ERR_WRITE_REG_ZERO : 0;
+    }
+    uint32_t* r = reg_[in.WriteDest].data();
+    // print iff changed
+    if (Trace::snapshot) for (size_t l = 0; l < n; ++l) print[l] = r[l] != data[l];
+    std::copy(data, data + n, r);
+    return 0;
+}
+
+template <class Trace>
+uint32_t lockstep<Trace>::MEM() {
+    const EXMEM_Buffer& in = EX_MEM[cur_];
+    MEMWB_Buffer& out = MEM_WB[cur_ ^ 1];
+    const IR::Decoded& d = imem_->getDecoded(in.slot);
+    const IR::OpInfo& op = IR::Ops[d.op];
+    if (Trace::snapshot) stages_[3] = StageLabel(d.op);
+    out.slot = in.slot;
+    out.WriteDest = in.WriteDest;
+    out.RegWrite = in.RegWrite;
+    out.RegPrint = false;
+    const size_t n = lanes_.size();
+    const uint32_t* alu = alu_[cur_].data();
+    uint32_t* data = wb_[cur_ ^ 1].data();
+    std::copy(alu, alu + n, data);
+    if (op.width == 0) return 0;
+    // every lane has its own data memory: one access at a time
+    if (op.store) {
+        if (!in.MemWrite) return 0;
+        const uint32_t* addr = addr_[cur_].data();
+        for (size_t l = 0; l < n; ++l) {
+            memory& m = lanes_[l]->mem;
+            const uint32_t err = checkAccess(m, addr[l], op.width);
+            if (err) {
+                err_[l] |= err;
+                continue;
+            }
+            switch (op.width) {
+                case 4: { m.saveWord(addr[l], alu[l]); break; }
+                case 2: { m.saveHalfWord(addr[l], alu[l]); break; }
+                case 1: { m.saveByte(addr[l], alu[l]); break; }
+            }
+        }
+        return 0;
+    }
+    if (!in.MemRead) return 0;
+    for (size_t l = 0; l < n; ++l) {
+        const memory& m = lanes_[l]->mem;
+        const uint32_t err = checkAccess(m, alu[l], op.width);
+        if (err) {
+            err_[l] |= err;
+            continue;
+        }
+        switch (op.width) {
+            case 4: { data[l] = m.loadWord(alu[l]); break; }
+            case 2: {
+                const uint32_t v = m.loadHalfWord(alu[l]);
+                data[l] = op.sign ? SignExt16(v) : v & 0xffff;
+                break;
+            }
+            case 1: {
+                const uint32_t v = m.loadByte(alu[l]);
+                data[l] = op.sign ? SignExt8(v) : v & 0xff;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+template <class Trace>
+uint32_t lockstep<Trace>::EX() {
+    // forwarded operands replace the ones ID latched
+    const IDEX_Buffer& in = ID_EX[cur_];
+    const EXMEM_Buffer& exmem = EX_MEM[cur_];
+    const MEMWB_Buffer& memwb = MEM_WB[cur_];
+    EXMEM_Buffer& out = EX_MEM[cur_ ^ 1];
+    const IR::Decoded& d = imem_->getDecoded(in.slot);
+    const IR::OpInfo& op = IR::Ops[d.op];
+    if (Trace::snapshot) stages_[2] = StageLabel(d.op);
+    out.slot = in.slot;
+    const size_t n = lanes_.size();
+    uint32_t* rs = rs_[cur_].data();
+    uint32_t* rt = rt_[cur_].data();
+    // fwd_EX-DM, fwd_DM-WB: the nearer writer wins
+    const uint32_t exDest = exmem.destMask(), wbDest = memwb.destMask();
+    if (exDest & d.srcRs) {
+        std::copy(alu_[cur_].begin(), alu_[cur_].end(), rs);
+        if (Trace::snapshot) {
+            stages_[2].note |= NOTE_FWD_EXDM_RS;
+            stages_[2].rs = d.rs;
+        }
+    } else if (wbDest & d.srcRs) {
+        std::copy(wb_[cur_].begin(), wb_[cur_].end(), rs);
+        if (Trace::snapshot) {
+            stages_[2].note |= NOTE_FWD_DMWB_RS;
+            stages_[2].rs = d.rs;
+        }
+    }
+    if (exDest & d.srcRt) {
+        std::copy(alu_[cur_].begin(), alu_[cur_].end(), rt);
+        if (Trace::snapshot) {
+            stages_[2].note |= NOTE_FWD_EXDM_RT;
+            stages_[2].rt = d.rt;
+        }
+    } else if (wbDest & d.srcRt) {
+        std::copy(wb_[cur_].begin(), wb_[cur_].end(), rt);
+        if (Trace::snapshot) {
+            stages_[2].note |= NOTE_FWD_DMWB_RT;
+            stages_[2].rt = d.rt;
+        }
+    }
+    out.MemWrite = out.MemRead = out.RegWrite = false;
+    out.isHILO = 0;
+    uint8_t* hilo = hilo_[cur_ ^ 1].data();
+    if (Trace::snapshot) std::fill(hilo, hilo + n, 0);
+    if (op.type == 'S' || op.type == 'F') return 0;
+    uint32_t* alu = alu_[cur_ ^ 1].data();
+    if (op.type == 'J') {
+        if (op.alu == IR::ALU_LINK) {
+            std::fill(alu, alu + n, in.jalPC);
+            out.WriteDest = 31;
+            out.RegWrite = true;
+        }
+        return 0;
+    }
+    out.WriteDest = op.type == 'R' ? d.rd : d.rt;
+    out.RegWrite = op.writes;
+    // nop and jr leave the previous result in place
+    if (op.type != 'I' && !op.writes && op.alu != IR::ALU_MULT && op.alu != IR::ALU_MULTU) return 0;
+    const uint32_t* b = rt;
+    if (op.type == 'I') {
+        b_.assign(n, d.imm);
+        b = b_.data();
+    }
+    // a store computes its address, the data is rt
+    uint32_t* res = op.store ? addr_[cur_ ^ 1].data() : alu;
+    uint32_t* err = err_.data();
+    switch (op.alu) {
+        case IR::ALU_NONE: { std::fill(res, res + n, 0); break; }
+        case IR::ALU_ADD: {
+            for (size_t l = 0; l < n; ++l) res[l] = rs[l] + b[l];
+            if (op.overflow) for (size_t l = 0; l < n; ++l) err[l] |= isOverflow(rs[l], b[l], res[l]);
+            break;
+        }
+        case IR::ALU_SUB: {
+            for (size_t l = 0; l < n; ++l) res[l] = rs[l] - b[l];
+            if (op.overflow) for (size_t l = 0; l < n; ++l) err[l] |= isSubOverflow(rs[l], b[l], res[l]);
+            break;
+        }
+        case IR::ALU_AND: { for (size_t l = 0; l < n; ++l) res[l] = rs[l] & b[l]; break; }
+        case IR::ALU_OR: { for (size_t l = 0; l < n; ++l) res[l] = rs[l] | b[l]; break; }
+        case IR::ALU_XOR: { for (size_t l = 0; l < n; ++l) res[l] = rs[l] ^ b[l]; break; }
+        case IR::ALU_NOR: { for (size_t l = 0; l < n; ++l) res[l] = ~(rs[l] | b[l]); break; }
+        case IR::ALU_NAND: { for (size_t l = 0; l < n; ++l) res[l] = ~(rs[l] & b[l]); break; }
+        case IR::ALU_SLT: {
+            for (size_t l = 0; l < n; ++l) res[l] = int32_t(rs[l]) < int32_t(b[l]) ? 1 : 0;
+            break;
+        }
+        case IR::ALU_SLL: { for (size_t l = 0; l < n; ++l) res[l] = rt[l] << d.shamt; break; }
+        case IR::ALU_SRL: { for (size_t l = 0; l < n; ++l) res[l] = rt[l] >> d.shamt; break; }
+        case IR::ALU_SRA: { for (size_t l = 0; l < n; ++l) res[l] = int32_t(rt[l]) >> d.shamt; break; }
+        case IR::ALU_MFHI: {
+            std::copy(HI_.begin(), HI_.end(), res);
+            HILOlock_ = false;
+            break;
+        }
+        case IR::ALU_MFLO: {
+            std::copy(LO_.begin(), LO_.end(), res);
+            HILOlock_ = false;
+            break;
+        }
+        case IR::ALU_LUI: { std::copy(b, b + n, res); break; }
+        case IR::ALU_MULT: case IR::ALU_MULTU: {
+            uint32_t* HI = HI_.data();
+            uint32_t* LO = LO_.data();
+            for (size_t l = 0; l < n; ++l) {
+                const uint64_t m = op.alu == IR::ALU_MULT ?
+                    uint64_t(SignExt32(rs[l]) * SignExt32(rt[l])) : uint64_t(rs[l]) * uint64_t(rt[l]);
+                const uint32_t hi = m >> 32, lo = m & 0x00000000ffffffff;
+                if (Trace::snapshot) hilo[l] = (hi == HI[l] ? 0x0 : 0x01) | (lo == LO[l] ? 0x0 : 0x10);
+                HI[l] = hi;
+                LO[l] = lo;
+            }
+            const bool locked = HILOlock_;
+            HILOlock_ = true;
+            return locked ? ERR_OVERWRTIE_REG_HI_LO : 0;
+        }
+    }
+    if (op.width != 0) {
+        if (op.store) {
+            std::copy(rt, rt + n, alu);
+            out.MemWrite = true;
+        } else {
+            out.MemRead = true;
+        }
+    }
+    return 0;
+}
+
+template <class Trace>
+uint32_t lockstep<Trace>::ID() {
+    // EX and DM have already written their latches this cycle
+    const IFID_Buffer& in = IF_ID[cur_];
+    const EXMEM_Buffer& exmem = EX_MEM[cur_ ^ 1];
+    const MEMWB_Buffer& memwb = MEM_WB[cur_ ^ 1];
+    IDEX_Buffer& out = ID_EX[cur_ ^ 1];
+    const IR::Decoded& d = imem_->getDecoded(in.slot);
+    if (Trace::snapshot) stages_[1] = StageLabel(d.op);
+    branch_ = BRANCH_NONE;
+    const size_t n = lanes_.size();
+    uint32_t* rs = rs_[cur_ ^ 1].data();
+    uint32_t* rt = rt_[cur_ ^ 1].data();
+    const uint32_t* fwd = wb_[cur_ ^ 1].data();
+    const auto bubble = [&] {
+        if (Trace::snapshot) stages_[1].note |= NOTE_STALLED;
+        out.slot = 0;
+        std::fill(rs, rs + n, 0);
+        std::fill(rt, rt + n, 0);
+        return 0;
+    };
+    // stall: load-use
+    if (imem_->getDecoded(ID_EX[cur_].slot).load & d.src) stall = true;
+    if (stall) return bubble();
+    out.slot = in.slot;
+    switch (d.type) {
+        case 'R': {
+            std::copy(reg_[d.rs].begin(), reg_[d.rs].end(), rs);
+            std::copy(reg_[d.rt].begin(), reg_[d.rt].end(), rt);
+            if (d.op == IR::OP_JR) {
+                // stall: rs in EX, or a load in DM
+                if ((exmem.destMask() | imem_->getDecoded(memwb.slot).load) & d.rsMask) {
+                    stall = true;
+                    return bubble();
+                }
+                // fwd_EX-DM
+                if (memwb.destMask() & d.rsMask) {
+                    std::copy(fwd, fwd + n, rs);
+                    if (Trace::snapshot) {
+                        stages_[1].note |= NOTE_FWD_EXDM_RS;
+                        stages_[1].rs = d.rs;
+                    }
+                }
+                // the group follows the first lane
+                flush = true;
+                branch_ = BRANCH_JR;
+                PC_ = rs[0];
+            }
+            break;
+        }
+        case 'I': {
+            std::copy(reg_[d.rs].begin(), reg_[d.rs].end(), rs);
+            std::copy(reg_[d.rt].begin(), reg_[d.rt].end(), rt);
+            if (d.op == IR::OP_BEQ || d.op == IR::OP_BNE || d.op == IR::OP_BGTZ) {
+                const uint32_t Caddr = d.imm << 2;
+                const uint32_t rtMask = d.op != IR::OP_BGTZ ? d.rtMask : 0;
+                if ((exmem.destMask() & (d.rsMask | rtMask)) ||
+                    (imem_->getDecoded(memwb.slot).load & (d.rsMask | d.rtMask))) {
+                    stall = true;
+                    return bubble();
+                }
+                // fwd_EX-DM
+                const uint32_t wbDest = memwb.destMask();
+                if (wbDest & d.rsMask) {
+                    std::copy(fwd, fwd + n, rs);
+                    if (Trace::snapshot) {
+                        stages_[1].note |= NOTE_FWD_EXDM_RS;
+                        stages_[1].rs = d.rs;
+                    }
+                }
+                if (wbDest & rtMask) {
+                    std::copy(fwd, fwd + n, rt);
+                    if (Trace::snapshot) {
+                        stages_[1].note |= NOTE_FWD_EXDM_RT;
+                        stages_[1].rt = d.rt;
+                    }
+                }
+                uint8_t* taken = taken_.data();
+                switch (d.op) {
+                    case IR::OP_BEQ: { for (size_t l = 0; l < n; ++l) taken[l] = rs[l] == rt[l]; break; }
+                    case IR::OP_BNE: { for (size_t l = 0; l < n; ++l) taken[l] = rs[l] != rt[l]; break; }
+                    default: { for (size_t l = 0; l < n; ++l) taken[l] = int32_t(rs[l]) > 0; break; }
+                }
+                size_t count = 0;
+                for (size_t l = 0; l < n; ++l) count += taken[l];
+                // the group follows the majority
+                follow_ = 2 * count > n;
+                if (count != 0 && count != n) branch_ = BRANCH_COND;
+                idPC_ = PC_;
+                target_ = PC_ + Caddr;
+                if (follow_) {
+                    flush = true;
+                    PC_ = target_;
+                }
+            }
+            break;
+        }
+        case 'J': {
+            out.jalPC = PC_;
+            // j && jal: PC = {(PC+4)[31:28], C, 2'b0}
+            flush = true;
+            PC_ = (PC_ & 0xf0000000) | (d.C << 2);
+            break;
+        }
+        case 'S': {
+            break;
+        }
+        default: {
+            return ERR_ILLEGAL;
+        }
+    }
+    return 0;
+}
+
+template <class Trace>
+void lockstep<Trace>::IF() {
+    if (Trace::snapshot) stages_[0] = StageLabel();
+    IFID_Buffer& out = IF_ID[cur_ ^ 1];
+    if (stall) {
+        if (Trace::snapshot) stages_[0].note = NOTE_STALLED;
+        out.slot = IF_ID[cur_].slot;
+        stall = false;
+        return;
+    }
+    if (flush) {
+        if (Trace::snapshot) stages_[0].note = NOTE_FLUSHED;
+        out.slot = 0;
+        flush = false;
+        return;
+    }
+    out.slot = imem_->getSlot(PC_);
+    PC_ += 4;
+}
+
+template class lockstep<TraceFull>;
+template class lockstep<TraceErrorsOnly>;
+template class lockstep<TraceNone>;
@@ -0,0 +1,98 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "simulator.hpp"
+
+// many instances of one instruction image, each with its own data image,
+// stepped together. The control path (latched slots, stall, flush, PC,
+// HI/LO lock) is shared by the group; the data path is kept per lane in
+// columns, so every stage is a loop over the lanes that the compiler
+// vectorises. Lanes that disagree on a branch or jr split off into a group
+// of their own, a halting error retires its lane. Each lane's reports and
+// result are those of Simulator<Trace> on the same images.
+template <class Trace>
+class lockstep {
+public:
+    struct Result {
+        SimulatorBase::Status status = SimulatorBase::RUNNING;
+        size_t cycles = 0, retired = 0;
+        bool written = true; // the reports were written in full
+    };
+    lockstep() : results_(&own_) {}
+    lockstep(const lockstep&) = delete;
+    lockstep& operator=(const lockstep&) = delete;
+    // instruction and data memory in bytes, before anything is loaded
+    bool setMemorySize(const uint64_t isize, const uint64_t dsize);
+    bool loadInstr(const char* iimage = "iimage.bin");
+    // one lane per data image, with its reports unless Trace has none;
+    // a lane that fails to load or open is not added
+    bool addLane(const char* dimage, const char* snapshot = "snapshot.rpt",
+        const char* error_dump = "error_dump.rpt", const bool direct = false);
+    void setCycleLimit(const size_t rhs) { limit_ = rhs; }
+    // every lane to its end, reports closed; returns the groups the lanes ran in
+    size_t run();
+    const size_t getLaneCount() const { return own_.size(); }
+    const Result& getResult(const size_t lane) const { return own_[lane]; }
+
+private:
+    // one instance: its data memory and reports
+    struct Lane {
+        explicit Lane(const size_t id) : id(id) {}
+        size_t id; // index into results
+        memory mem;
+        report snapshot, error_dump;
+        tracer out{snapshot, error_dump};
+    };
+    enum Branch : uint8_t { BRANCH_NONE, BRANCH_COND, BRANCH_JR };
+    // the control state of parent after a cycle, without lanes
+    lockstep(const lockstep& parent, std::vector<Result>* results);
+    bool step(std::vector<std::unique_ptr<lockstep>>&);
+    bool endCycle();
+    void split(std::vector<std::unique_ptr<lockstep>>&);
+    void traceRegs(const size_t);
+    void finish(const size_t, const SimulatorBase::Status);
+    void finishAll(const SimulatorBase::Status);
+    void removeLane(const size_t);
+    void moveLane(const size_t, lockstep&);
+    bool halted() const;
+    uint32_t WB();
+    uint32_t MEM();
+    uint32_t EX();
+    uint32_t ID();
+    void IF();
+    // f(column of a, column of b) for every per-lane column
+    template <class F> static void columns(lockstep& a, lockstep& b, F&& f);
+
+    std::shared_ptr<memory> imem_ = std::make_shared<memory>(); // instructions, shared by the groups
+    uint64_t dsize_ = DATA_SIZE;
+    uint32_t PC_ = 0;
+    // control halves of the latches, their data fields unused
+    IFID_Buffer IF_ID[2];
+    IDEX_Buffer ID_EX[2];
+    EXMEM_Buffer EX_MEM[2];
+    MEMWB_Buffer MEM_WB[2];
+    uint8_t cur_ = 0;
+    bool stall = false, flush = false, HILOlock_ = false;
+    bool full_ = true;
+    size_t cycle_ = 0, limit_ = 500000, retired_ = 0;
+    StageLabel stages_[5];
+    // a branch or jr resolved in ID this cycle, lanes may disagree on it
+    Branch branch_ = BRANCH_NONE;
+    uint32_t idPC_ = 0, target_ = 0;
+    bool follow_ = false;
+
+    std::vector<std::unique_ptr<Lane>> lanes_;
+    // per-lane columns, [cur_] as in Simulator
+    std::vector<uint32_t> reg_[32], HI_, LO_;
+    std::vector<uint32_t> rs_[2], rt_[2]; // ID/EX
+    std::vector<uint32_t> alu_[2], addr_[2]; // EX/MEM ALU_Result, store address
+    std::vector<uint32_t> wb_[2]; // MEM/WB rt_data
+    std::vector<uint8_t> hilo_[2], print_[2]; // EX/MEM isHILO, MEM/WB RegPrint
+    std::vector<uint32_t> err_; // raised in the previous cycle
+    std::vector<uint8_t> taken_; // conditional branch outcome this cycle
+    std::vector<uint32_t> b_; // ALU operand b of an I-type, the immediate
+    std::vector<TraceRecord> recs_;
+
+    std::vector<Result> own_;
+    std::vector<Result>* results_; // the first group's, shared with the split ones
+};
@@ -1,494 +1,244 @@
-#include "main.hpp"
+#include "simulator.hpp"
+#include "interp.hpp"
 
-int main() {
-    snapshot = fopen("snapshot.rpt", "w");
-    error_dump = fopen("error_dump.rpt", "w");
-    mem.LoadInstr();
-    const uint32_t SP = mem.LoadData();
-    reg.setReg(29, SP);
-    uint32_t err = 0, instr;
-    for (size_t cycle = 0; cycle <= 500000; ++cycle) {
-        dump_error(err, cycle);
-        if (err & HALT) break;
-        dump_reg(cycle);
-        err = 0;
-        err |= WB();
-        err |= MEM();
-        err |= EX();
-        instr = mem.getInstr();
-        err |= ID();
-        if (err & ERR_ILLEGAL) {
-            printf("illegal instruction found at 0x%X\n", mem.getPC());
-            break;
-        }
-        err |= IF();
-        fprintf(snapshot, "IF: 0x%08X%s\nID: %s\nEX: %s\nDM: %s\nWB: %s\n\n\n",
-            instr, stages[0].c_str(), stages[1].c_str(), stages[2].c_str(),
-            stages[3].c_str(), stages[4].c_str());
-        if (IR::getOpName(IF_ID.instr) == "HALT" && stages[1] == "HALT" &&
-            stages[2] == "HALT" && stages[3] == "HALT" && stages[4] == "HALT") break;
-    }
-    fclose(snapshot);
-    fclose(error_dump);
-    return 0;
-}
-
-void dump_reg(const size_t cycle) {
-    fprintf(snapshot, "cycle %zu\n", cycle);
-    if (cycle == 0) {
-        for (int i = 0; i < 32; ++i) {
-            fprintf(snapshot, "$%02d: 0x%08X\n", i, reg.getReg(i));
-        }
-        fprintf(snapshot, "$HI: 0x%08X\n$LO: 0x%08X\n", 0, 0);
-    }
-    if (MEM_WB_t.RegPrint) {
-        fprintf(snapshot, "$%02d: 0x%08X\n", MEM_WB_t.WriteDest, MEM_WB_t.rt_data);
-    }
-    if (EX_MEM.isHILO & 0x01) {
-        fprintf(snapshot, "$HI: 0x%08X\n", reg.getHI());
-    }
-    if (EX_MEM.isHILO & 0x10) {
-        fprintf(snapshot, "$LO: 0x%08X\n", reg.getLO());
-    }
-    fprintf(snapshot, "PC: 0x%08X\n", mem.getPC());
-}
-
-void dump_error(const uint32_t ex, const size_t cycle) {
-    if (ex & ERR_WRITE_REG_ZERO) {
-        fprintf(error_dump, "In cycle %zu: Write $0 Error\n", cycle);
-    }
-    if (ex & ERR_ADDRESS_OVERFLOW) {
-        fprintf(error_dump, "In cycle %zu: Address Overflow\n", cycle);
-    }
-    if (ex & ERR_MISALIGNMENT) {
-        fprintf(error_dump, "In cycle %zu: Misalignment Error\n", cycle);
-    }
-    if (ex & ERR_OVERWRTIE_REG_HI_LO) {
-        fprintf(error_dump, "In cycle %zu: Overwrite HI-LO registers\n", cycle);
-    }
+struct Options {
+    bool direct = false;
+    size_t ffCount = 0, ckptEvery = 0;
+    uint64_t isize = INSTR_SIZE, dsize = DATA_SIZE;
+    uint64_t ffPC = FF_NO_PC;
+    const char *ckptPath = "checkpoint.bin", *resume = nullptr;
+    bool stats = false, blockCache = false, interp = false, binary = false;
+    const char* statsJSON = nullptr;
+    const char *profile = nullptr, *folded = nullptr;
+    size_t profileTop = 20;
+    TraceFilter filter;
+};
 
-    if (ex & ERR_NUMBER_OVERFLOW) {
-        fprintf(error_dump, "In cycle %zu: Number Overflow\n", cycle);
-    }
+// "lo:hi" inclusive, either end may be left out
+static bool parseRange(const char* arg, uint64_t& lo, uint64_t& hi) {
+    const char* colon = strchr(arg, ':');
+    if (colon == nullptr) return false;
+    char* end;
+    if (colon != arg) {
+        lo = strtoull(arg, &end, 0);
+        if (end != colon) return false;
+    }
+    if (colon[1] != '\0') {
+        hi = strtoull(colon + 1, &end, 0);
+        if (*end != '\0') return false;
+    }
+    return lo <= hi;
 }
 
-/**
-* Five Stages
-*/
-
-uint32_t WB() {
-    stages[4] = IR::getOpName(MEM_WB.instr);
-    MEM_WB_t = MEM_WB;
-    const uint32_t& dest = MEM_WB.WriteDest, data = MEM_WB.rt_data;
-    // print iff changed
-    if (MEM_WB.RegWrite) {
-        MEM_WB_t.RegPrint = dest != 0 && reg.getReg(dest) != data;
-        if (dest == 0) return ERR_WRITE_REG_ZERO;
-        else reg.setReg(dest, data);
-    }
-    return 0;
-}
-
-uint32_t MEM() {
-    stages[3] = IR::getOpName(EX_MEM.instr);
-    MEM_WB.instr = EX_MEM.instr;
-    MEM_WB.rt_data = EX_MEM.ALU_Result;
-    MEM_WB.WriteDest = EX_MEM.WriteDest;
-    MEM_WB.RegWrite = EX_MEM.RegWrite;
-    const uint32_t& opcode = EX_MEM.opcode,
-            MemWrite = EX_MEM.MemWrite,
-            MemRead = EX_MEM.MemRead,
-            WriteDest = EX_MEM.WriteDest,
-            ALU_Result = EX_MEM.ALU_Result;
-    uint32_t err = 0;
-    // add overflow: sw, sh, lw, lh, lhu
-    if (opcode == 0x2B && MemWrite) { // sw
-        err |= (WriteDest >= 1024 || WriteDest + 1 >= 1024 ||
-            WriteDest + 2 >= 1024 || WriteDest + 3 >= 1024 ? ERR_ADDRESS_OVERFLOW : 0);
-        err |= (WriteDest % 4 != 0 ? ERR_MISALIGNMENT : 0);
-        if (err & HALT) return err;
-        mem.saveWord(WriteDest, ALU_Result);
-    } else if (opcode == 0x29 && MemWrite) { // sh
-        err |= (WriteDest >= 1024 || WriteDest + 1 >= 1024 ? ERR_ADDRESS_OVERFLOW : 0);
-        err |= (WriteDest % 2 != 0 ? ERR_MISALIGNMENT : 0);
-        if (err & HALT) return err;
-        mem.saveHalfWord(WriteDest, ALU_Result);
-    } else if (opcode == 0x28 && MemWrite) { // sb
-        err |= (WriteDest >= 1024 ? ERR_ADDRESS_OVERFLOW : 0);
-        if (err & HALT) return err;
-        mem.saveByte(WriteDest, ALU_Result);
-    } else if (opcode == 0x23 && MemRead) { // lw
-        err |= (ALU_Result >= 1024 || ALU_Result + 1 >= 1024 ||
-            ALU_Result + 2 >= 1024 || ALU_Result + 3 >= 1024 ? ERR_ADDRESS_OVERFLOW : 0);
-        err |= (ALU_Result % 4 != 0 ? ERR_MISALIGNMENT : 0);
-        if (err & HALT) return err;
-        MEM_WB.rt_data = mem.loadWord(ALU_Result);
-    } else if (opcode == 0x21 && MemRead) { // lh
-        err |= (ALU_Result >= 1024 || ALU_Result + 1 >= 1024 ? ERR_ADDRESS_OVERFLOW : 0);
-        err |= (ALU_Result % 2 != 0 ? ERR_MISALIGNMENT : 0);
-        if (err & HALT) return err;
-        MEM_WB.rt_data = SignExt16(mem.loadHalfWord(ALU_Result));
-    } else if (opcode == 0x25 && MemRead) { // lhu
-        err |= (ALU_Result >= 1024 || ALU_Result + 1 >= 1024 ? ERR_ADDRESS_OVERFLOW : 0);
-        err |= (ALU_Result % 2 != 0 ? ERR_MISALIGNMENT : 0);
-        if (err & HALT) return err;
-        MEM_WB.rt_data = mem.loadHalfWord(ALU_Result) & 0xffff;
-    } else if (opcode == 0x20 && MemRead) { // lb
-        err |= (ALU_Result >= 1024 ? ERR_ADDRESS_OVERFLOW : 0);
-        if (err & HALT) return err;
-        MEM_WB.rt_data = SignExt8(mem.loadByte(ALU_Result));
-    } else if (opcode == 0x24 && MemRead) { // lbu
-        err |= (ALU_Result >= 1024 ? ERR_ADDRESS_OVERFLOW : 0);
-        if (err & HALT) return err;
-        MEM_WB.rt_data = mem.loadByte(ALU_Result) & 0xff;
+// stdout is compared against the golden output, so the CPI goes to stderr
+static bool printStats(const Options& opt, const counters& c, const size_t cycles, const size_t retired) {
+    if (opt.stats) c.print(stderr, cycles, retired);
+    if (opt.statsJSON) {
+        FILE* f = fopen(opt.statsJSON, "w");
+        if (f == nullptr) {
+            perror(opt.statsJSON);
+            return false;
+        }
+        c.printJSON(f, cycles, retired);
+        fclose(f);
     }
-    return err;
+    return true;
 }
 
-uint32_t EX() {
-    stages[2] = IR::getOpName(ID_EX.instr);
-    EX_MEM.instr = ID_EX.instr;
-    EX_MEM.opcode = ID_EX.opcode;
-    // fwd_EX-DM, fwd_DM-WB
-    bool fwd_rs = IR::has_rs(EX_MEM.instr);
-    if (EX_MEM.RegWrite && fwd_rs && EX_MEM.WriteDest != 0 && EX_MEM.WriteDest == ID_EX.rs) {
-        ID_EX.rs = EX_MEM.WriteDest;
-        ID_EX.rs_data = EX_MEM.ALU_Result;
-        stages[2] += " fwd_EX-DM_rs_$" + std::to_string(EX_MEM.WriteDest);
-    } else if (MEM_WB_t.RegWrite && fwd_rs && MEM_WB_t.WriteDest != 0 && MEM_WB_t.WriteDest == ID_EX.rs) {
-        ID_EX.rs = MEM_WB_t.WriteDest;
-        ID_EX.rs_data = MEM_WB_t.rt_data;
-        stages[2] += " fwd_DM-WB_rs_$" + std::to_string(MEM_WB_t.WriteDest);
-    }
-    bool fwd_rt = IR::has_rt(EX_MEM.instr);
-    if (EX_MEM.RegWrite && fwd_rt && EX_MEM.WriteDest != 0 && EX_MEM.WriteDest == ID_EX.rt) {
-        ID_EX.rt = EX_MEM.WriteDest;
-        ID_EX.rt_data = EX_MEM.ALU_Result;
-        stages[2] += " fwd_EX-DM_rt_$" + std::to_string(EX_MEM.WriteDest);
-    } else if (MEM_WB_t.RegWrite && fwd_rt && MEM_WB_t.WriteDest != 0 && MEM_WB_t.WriteDest == ID_EX.rt) {
-        ID_EX.rt = MEM_WB_t.WriteDest;
-        ID_EX.rt_data = MEM_WB_t.rt_data;
-        stages[2] += " fwd_DM-WB_rt_$" + std::to_string(MEM_WB_t.WriteDest);
-    }
-    uint32_t err;
-    EX_MEM.MemWrite = EX_MEM.MemRead = EX_MEM.RegWrite = false;
-    EX_MEM.isHILO = 0;
-    switch (ID_EX.type) {
-        case 'R': { err = R_execute(); break; }
-        case 'I': { err = I_execute(); break; }
-        case 'J': { err = J_execute(); break; }
-        case 'S': default: { break; }
-    }
-    return err;
+// a report cut short by a failed write must not pass for a finished run
+template <class T>
+static bool finishReports(T& sim) {
+    if (sim.closeReports()) return true;
+    perror("pipeline");
+    return false;
 }
 
-uint32_t ID() {
-    const uint32_t& instr = IF_ID.instr;
-    stages[1] = IR::getOpName(instr);
-    // stall
-    bool stall_rs = IR::has_rs(IF_ID.instr);
-    if (IR::isMemRead(ID_EX.instr) && stall_rs && IF_ID.rs != 0 && ID_EX.rt == IF_ID.rs) {
-        stall = true;
-    }
-    bool stall_rt = IR::has_rt(IF_ID.instr);
-    if (IR::isMemRead(ID_EX.instr) && stall_rt && IF_ID.rt != 0 && ID_EX.rt == IF_ID.rt) {
-        stall = true;
-    }
-    if (stall) {
-        stages[1] += " to_be_stalled";
-        ID_EX.type = 'R';
-        ID_EX.instr = ID_EX.opcode = ID_EX.rs = ID_EX.rt = ID_EX.rd
-            = ID_EX.shamt = ID_EX.funct = ID_EX.C
-            = ID_EX.rs_data = ID_EX.rt_data = 0;
-        return 0;
-    }
-    // ID
-    ID_EX.instr = instr;
-    ID_EX.type = IR::getType(instr);
-    switch (ID_EX.type) {
-        case 'R': {
-            ID_EX.opcode = (instr >> 26) & 0x3f;
-            ID_EX.rs = (instr >> 21) & 0x1f;
-            ID_EX.rt = (instr >> 16) & 0x1f;
-            ID_EX.rd = (instr >> 11) & 0x1f;
-            ID_EX.shamt = (instr >> 6) & 0x1f;
-            ID_EX.funct = instr & 0x3f;
-            ID_EX.rs_data = reg.getReg(ID_EX.rs);
-            ID_EX.rt_data = reg.getReg(ID_EX.rt);
-            // jr
-            if (ID_EX.funct == 0x08) {
-                // stall
-                if (EX_MEM.RegWrite && EX_MEM.WriteDest != 0 && EX_MEM.WriteDest == IF_ID.rs) {
-                    stall = true;
-                }
-                if (IR::isMemRead(MEM_WB.instr) && MEM_WB.WriteDest != 0 && MEM_WB.WriteDest == IF_ID.rs) {
-                    stall = true;
-                }
-                if (stall) {
-                    stall = true;
-                    stages[1] += " to_be_stalled";
-                    ID_EX.type = 'R';
-                    ID_EX.instr = ID_EX.opcode = ID_EX.rs = ID_EX.rt = ID_EX.rd
-                        = ID_EX.shamt = ID_EX.funct = ID_EX.C
-                        = ID_EX.rs_data = ID_EX.rt_data = 0;
-                    return 0;
-                }
-                // fwd_EX-DM
-                if (MEM_WB.RegWrite && MEM_WB.WriteDest != 0 && MEM_WB.WriteDest == ID_EX.rs) {
-                    ID_EX.rs_data = MEM_WB.rt_data;
-                    stages[1] += " fwd_EX-DM_rs_$" + std::to_string(ID_EX.rs);
-                }
-                flush = true;
-                mem.setPC(ID_EX.rs_data);
-            }
-            break;
-        }
-        case 'I': {
-            ID_EX.opcode = (instr >> 26) & 0x3f;
-            ID_EX.rs = (instr >> 21) & 0x1f;
-            ID_EX.rt = (instr >> 16) & 0x1f;
-            ID_EX.C = instr & 0xffff;
-            ID_EX.rs_data = reg.getReg(ID_EX.rs);
-            ID_EX.rt_data = reg.getReg(ID_EX.rt);
-            // beq, bne, bgtz (signed)
-            if (ID_EX.opcode == 0x04 || ID_EX.opcode == 0x05 || ID_EX.opcode == 0x07) {
-                // {14'{C[15]}, C, 2'b0}
-                const int32_t Caddr = ID_EX.C >> 15 == 0x0 ? (0x0003ffff & (ID_EX.C << 2)) :
-                    (0xfffc0000 | (ID_EX.C << 2));
-                // stall
-                if (EX_MEM.RegWrite && EX_MEM.WriteDest != 0 && EX_MEM.WriteDest == IF_ID.rs) {
-                    stall = true;
-                }
-                if (IR::isMemRead(MEM_WB.instr) && MEM_WB.WriteDest != 0 && MEM_WB.WriteDest == IF_ID.rs) {
-                    stall = true;
-                }
-                bool has_rt = ID_EX.opcode != 0x07;
-                if (EX_MEM.RegWrite && EX_MEM.WriteDest != 0 && has_rt && EX_MEM.WriteDest == IF_ID.rt) {
-                    stall = true;
-                }
-                if (IR::isMemRead(MEM_WB.instr) && MEM_WB.WriteDest != 0 && MEM_WB.WriteDest == IF_ID.rt) {
-                    stall = true;
-                }
-                if (stall) {
-                    stall = true;
-                    stages[1] += " to_be_stalled";
-                    ID_EX.type = 'R';
-                    ID_EX.instr = ID_EX.opcode = ID_EX.rs = ID_EX.rt = ID_EX.rd
-                        = ID_EX.shamt = ID_EX.funct = ID_EX.C
-                        = ID_EX.rs_data = ID_EX.rt_data = 0;
-                    return 0;
-                }
-                // fwd_EX-DM
-                if (MEM_WB.RegWrite && MEM_WB.WriteDest != 0 && MEM_WB.WriteDest == ID_EX.rs) {
-                    ID_EX.rs_data = MEM_WB.rt_data;
-                    stages[1] += " fwd_EX-DM_rs_$" + std::to_string(ID_EX.rs);
-                }
-                if (MEM_WB.RegWrite && MEM_WB.WriteDest != 0 && ID_EX.opcode != 0x07 && MEM_WB.WriteDest == ID_EX.rt) {
-                    ID_EX.rt_data = MEM_WB.rt_data;
-                    stages[1] += " fwd_EX-DM_rt_$" + std::to_string(ID_EX.rt);
-                }
-                if ((ID_EX.opcode == 0x04 && ID_EX.rs_data == ID_EX.rt_data) ||
-                    (ID_EX.opcode == 0x05 && ID_EX.rs_data != ID_EX.rt_data) ||
-                    (ID_EX.opcode == 0x07 && int32_t(ID_EX.rs_data) > 0))
-                {
-                    flush = true;
-                    mem.setPC(int32_t(mem.getPC()) + Caddr);
-                }
-            }
-            break;
-        }
-        case 'J': {
-            ID_EX.opcode = (instr >> 26) & 0x3f;
-            ID_EX.C = instr & 0x3ffffff;
-            ID_EX.jalPC = mem.getPC();
-            // j && jal: PC = {(PC+4)[31:28], C, 2'b0}
-            flush = true;
-            mem.setPC((mem.getPC() & 0xf0000000) | (ID_EX.C << 2));
-            break;
+template <class Trace>
+static int simulate(const Options& opt) {
+    Simulator<Trace> sim;
+    if (!sim.setMemorySize(opt.isize, opt.dsize)) {
+        fprintf(stderr, "pipeline: memory sizes must be 4 bytes to 4 GiB\n");
+        return 1;
+    }
+    if (opt.resume) {
+        if (!sim.resume(opt.resume)) {
+            fprintf(stderr, "pipeline: cannot resume from %s\n", opt.resume);
+            return 1;
         }
-        case 'S': {
-            ID_EX.opcode = (instr >> 26) & 0x3f;
-            ID_EX.C = instr & 0x3ffffff;
-            break;
+    } else if (!sim.loadImages()) {
+        perror("pipeline");
+        return 1;
+    }
+    sim.setBinaryTrace(opt.binary);
+    if (!sim.openReports(opt.binary ? "snapshot.trc" : "snapshot.rpt", "error_dump.rpt", opt.direct)) {
+        perror("pipeline");
+        return 1;
+    }
+    if (sim.reportsRestarted()) {
+        fprintf(stderr, "pipeline: reports restart at cycle %zu\n", sim.getCycle());
+    }
+    if (opt.ffCount > 0) {
+        const size_t n = sim.fastForward(opt.ffCount, opt.ffPC);
+        fprintf(stderr, "fast-forwarded %zu instructions to PC 0x%08X\n", n, sim.getMemory().getPC());
+    }
+    if (opt.profile || opt.folded) sim.enableProfile();
+    sim.setTraceFilter(opt.filter);
+    sim.setBlockCache(opt.blockCache);
+    const size_t first = sim.getCycle();
+    // checkpoints are taken between cycles, the block cache runs whole blocks
+    if (opt.ckptEvery == 0) sim.run();
+    while (sim.step()) {
+        const size_t cycle = sim.getCycle();
+        if (cycle % opt.ckptEvery == 0 && cycle != first && !sim.saveCheckpoint(opt.ckptPath)) {
+            fprintf(stderr, "pipeline: cannot write checkpoint %s\n", opt.ckptPath);
         }
-        default: {
-            return ERR_ILLEGAL;
+    }
+    if (sim.getStatus() == SimulatorBase::ILLEGAL) {
+        printf("illegal instruction found at 0x%X\n", sim.getMemory().getPC());
+    }
+    if (!finishReports(sim)) return 1;
+    if (!printStats(opt, sim.getCounters(), sim.getCycle(), sim.getRetired())) return 1;
+    for (const char* path : {opt.profile, opt.folded}) {
+        if (path == nullptr) continue;
+        FILE* f = fopen(path, "w");
+        if (f == nullptr) {
+            perror(path);
+            return 1;
         }
+        if (path == opt.profile) sim.printProfile(f, opt.profileTop);
+        else sim.printFoldedProfile(f);
+        fclose(f);
     }
     return 0;
 }
 
-uint32_t IF() {
-    stages[0] = "";
-    // stall
-    if (stall) {
-        stages[0] = " to_be_stalled";
-        stall = false;
-        return 0;
-    }
-    // flush
-    if (flush) {
-        stages[0] = " to_be_flushed";
-        IF_ID.instr = IF_ID.rs = IF_ID.rt = 0;
-        flush = false;
-        return 0;
-    }
-    IF_ID.instr = mem.getInstr();
-    mem.setPC(mem.getPC() + 4);
-    IF_ID.rs = (IF_ID.instr >> 21) & 0x1f;
-    IF_ID.rt = (IF_ID.instr >> 16) & 0x1f;
-    return 0;
+// the threaded-code interpreter: the reports of --trace errors, or none
+static int interpret(const Options& opt, const bool reports) {
+    interp sim;
+    if (!sim.setMemorySize(opt.isize, opt.dsize)) {
+        fprintf(stderr, "pipeline: memory sizes must be 4 bytes to 4 GiB\n");
+        return 1;
+    }
+    if (!sim.loadImages()) {
+        perror("pipeline");
+        return 1;
+    }
+    if (reports && !sim.openReports("snapshot.rpt", "error_dump.rpt", opt.direct)) {
+        perror("pipeline");
+        return 1;
+    }
+    if (sim.run() == SimulatorBase::ILLEGAL) {
+        printf("illegal instruction found at 0x%X\n", sim.getMemory().getPC());
+    }
+    if (!finishReports(sim)) return 1;
+    return printStats(opt, sim.getCounters(), sim.getCycle(), sim.getRetired()) ? 0 : 1;
 }
 
-/**
-* EX Stage
-* R type: R_execute()
-* I type: I_execute()
-* J type: J_execute()
-*/
+static int usage(const char* argv0) {
+    fprintf(stderr, "usage: %s [--direct] [--ff count] [--ff-pc addr] [--imem bytes] [--dmem bytes]\n"
+        "    [--checkpoint-every cycles] [--checkpoint file] [--resume file]\n"
+        "    [--trace full|async|errors|none] [--stats] [--stats-json file]\n"
+        "    [--profile file] [--profile-top n] [--profile-folded file]\n"
+        "    [--cycles from:to] [--pc lo:hi] [--watch-reg r,...] [--watch-addr lo:hi]\n"
+        "    [--watch-window cycles] [--block-cache] [--interp] [--binary-trace]\n"
+        "  ranges are inclusive; only cycles inside every filter given reach snapshot.rpt\n"
+        "  --block-cache replays cached block timing under --trace errors|none,\n"
+        "  without --profile or --checkpoint-every\n"
+        "  --interp runs the threaded-code interpreter under --trace errors|none,\n"
+        "  with no other option but --direct, --imem, --dmem and the stats\n"
+        "  --binary-trace writes snapshot.trc for pipeline-trace in place of snapshot.rpt,\n"
+        "  without --resume or --checkpoint-every\n", argv0);
+    return 1;
+}
 
-uint32_t R_execute() {
-    const uint32_t& funct = ID_EX.funct,
-            rs_data = ID_EX.rs_data,
-            rt_data = ID_EX.rt_data;
-    uint32_t res = 0, err = 0;
-    // EX_MEM
-    EX_MEM.RegWrite = true;
-    EX_MEM.WriteDest = ID_EX.rd;
-    if (ID_EX.rt == 0 && ID_EX.rd == 0 && ID_EX.shamt == 0 && ID_EX.funct == 0) { // NOP
-        EX_MEM.RegWrite = false;
-        return 0;
-    }
-    if (funct == 0x08) {
-        // jr
-        EX_MEM.RegWrite = false;
-        //mem.setPC(rs_data);
-    } else if (funct == 0x18) {
-        // mult (signed)
-        const int64_t m = SignExt32(rs_data) * SignExt32(rt_data);
-        const uint32_t HI = m >> 32, LO = m & 0x00000000ffffffff;
-        EX_MEM.isHILO = (HI == reg.getHI() ? 0x0 : 0x01) | (LO == reg.getLO() ? 0x0 : 0x10);
-        bool isOverwrite = reg.setHILO(HI, LO);
-        err |= (isOverwrite ? ERR_OVERWRTIE_REG_HI_LO : 0);
-        EX_MEM.RegWrite = false;
-    } else if (funct == 0x19) {
-        // multu
-        const uint64_t m = uint64_t(rs_data) * uint64_t(rt_data);
-        const uint32_t HI = m >> 32, LO = m & 0x00000000ffffffff;
-        EX_MEM.isHILO = (HI == reg.getHI() ? 0x0 : 0x01) | (LO == reg.getLO() ? 0x0 : 0x10);
-        bool isOverwrite = reg.setHILO(HI, LO);
-        err |= (isOverwrite ? ERR_OVERWRTIE_REG_HI_LO : 0);
-        EX_MEM.RegWrite = false;
-    } else {
-        switch (funct) {
-            // add (signed)
-            case 0x20: {
-                res = int32_t(rs_data) + int32_t(rt_data);
-                err |= isOverflow(rs_data, rt_data, res);
-                break;
+int main(int argc, char** argv) {
+    Options opt;
+    const char* trace = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--direct") == 0) opt.direct = true;
+        else if (strcmp(argv[i], "--ff") == 0 && i + 1 < argc) {
+            opt.ffCount = strtoull(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--ff-pc") == 0 && i + 1 < argc) {
+            opt.ffPC = strtoull(argv[++i], nullptr, 0) & 0xffffffff;
+            if (opt.ffCount == 0) opt.ffCount = SIZE_MAX;
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            opt.ckptEvery = strtoull(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            opt.ckptPath = argv[++i];
+        } else if (strcmp(argv[i], "--imem") == 0 && i + 1 < argc) {
+            opt.isize = strtoull(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--dmem") == 0 && i + 1 < argc) {
+            opt.dsize = strtoull(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace = argv[++i];
+        } else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+            opt.resume = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0) opt.stats = true;
+        else if (strcmp(argv[i], "--block-cache") == 0) opt.blockCache = true;
+        else if (strcmp(argv[i], "--interp") == 0) opt.interp = true;
+        else if (strcmp(argv[i], "--binary-trace") == 0) opt.binary = true;
+        else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            opt.statsJSON = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            opt.profile = argv[++i];
+        } else if (strcmp(argv[i], "--profile-top") == 0 && i + 1 < argc) {
+            opt.profileTop = strtoull(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--profile-folded") == 0 && i + 1 < argc) {
+            opt.folded = argv[++i];
+        } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            uint64_t lo = 0, hi = SIZE_MAX;
+            if (!parseRange(argv[++i], lo, hi)) return usage(argv[0]);
+            opt.filter.from = lo;
+            opt.filter.to = hi;
+        } else if (strcmp(argv[i], "--pc") == 0 && i + 1 < argc) {
+            uint64_t lo = 0, hi = 0xffffffff;
+            if (!parseRange(argv[++i], lo, hi)) return usage(argv[0]);
+            opt.filter.pcLo = lo;
+            opt.filter.pcHi = hi + 1;
+        } else if (strcmp(argv[i], "--watch-addr") == 0 && i + 1 < argc) {
+            uint64_t lo = 0, hi = 0xffffffff;
+            if (!parseRange(argv[++i], lo, hi)) return usage(argv[0]);
+            opt.filter.addrLo = lo;
+            opt.filter.addrHi = hi + 1;
+        } else if (strcmp(argv[i], "--watch-reg") == 0 && i + 1 < argc) {
+            // comma-separated register numbers, with or without '$'
+            for (char* p = argv[++i]; *p != '\0';) {
+                if (*p == '$') ++p;
+                const unsigned long r = strtoul(p, &p, 10);
+                if (r > 31 || (*p != ',' && *p != '\0')) return usage(argv[0]);
+                opt.filter.regs |= 1u << r;
+                if (*p == ',') ++p;
             }
-            // addu
-            case 0x21: { res = rs_data + rt_data; break; }
-            // sub (signed)
-            case 0x22: {
-                res = int32_t(rs_data) - int32_t(rt_data);
-                err |= isOverflow(rs_data, - int32_t(rt_data), res);
-                break;
-            }
-            // and
-            case 0x24: { res = rs_data & rt_data; break; }
-            // or
-            case 0x25: { res = rs_data | rt_data; break; }
-            // xor
-            case 0x26: { res = rs_data ^ rt_data; break; }
-            // nor
-            case 0x27: { res = ~(rs_data | rt_data); break; }
-            // nand
-            case 0x28: { res = ~(rs_data & rt_data); break; }
-            // slt (signed)
-            case 0x2A: {
-                res = int32_t(rs_data) < int32_t(rt_data) ? 1 : 0;
-                break;
-            }
-            // sll, NOP
-            case 0x00: { res = rt_data << ID_EX.shamt; break; }
-            // srl
-            case 0x02: { res = rt_data >> ID_EX.shamt; break; }
-            // sra
-            case 0x03: { res = int32_t(rt_data) >> ID_EX.shamt; break; }
-            // mfhi
-            case 0x10: { res = reg.fetchHI(); break; }
-            // mflo
-            case 0x12: { res = reg.fetchLO(); break; }
+        } else if (strcmp(argv[i], "--watch-window") == 0 && i + 1 < argc) {
+            opt.filter.window = strtoull(argv[++i], nullptr, 0);
+        } else {
+            return usage(argv[0]);
         }
-        EX_MEM.ALU_Result = res;
     }
-    return err;
-}
-
-uint32_t I_execute() {
-    const uint32_t& opcode = ID_EX.opcode,
-            rs_data = ID_EX.rs_data,
-            rt_data = ID_EX.rt_data,
-            C = ID_EX.C;
-    uint32_t res = 0, err = 0;
-    // EX_MEM
-    EX_MEM.RegWrite = true;
-    EX_MEM.WriteDest = ID_EX.rt;
-    switch (opcode) {
-        // addi (signed)
-        case 0x08: {
-            const int32_t Cext = SignExt16(C);
-            res = int32_t(rs_data) + Cext;
-            err |= isOverflow(rs_data, Cext, res);
-            break;
-        }
-        // addiu
-        case 0x09: { res = rs_data + SignExt16(C); break; }
-        //lui
-        case 0x0F: { res = C << 16; break; }
-        // andi
-        case 0x0C: { res = rs_data & ZeroExt16(C); break; }
-        // ori
-        case 0x0D: { res = rs_data | ZeroExt16(C); break; }
-        // nori
-        case 0x0E: { res = ~(rs_data | ZeroExt16(C)); break; }
-        // slti (signed)
-        case 0x0A: {
-            res = int32_t(rs_data) < int32_t(SignExt16(C)) ? 1 : 0;
-            break;
-        }
-        // sw, sh, sb
-        case 0x2B: case 0x29: case 0x28: {
-            const int32_t Cext = SignExt16(C);
-            res = int32_t(rs_data) + Cext;
-            err |= isOverflow(rs_data, Cext, res);
-            EX_MEM.WriteDest = res;
-            res = rt_data;
-            EX_MEM.MemWrite = true;
-            EX_MEM.RegWrite = false;
-            break;
+    if (opt.resume && opt.ffCount > 0) {
+        fprintf(stderr, "pipeline: --resume cannot be combined with --ff\n");
+        return 1;
+    }
+    // a checkpoint keeps the snapshot's offset, which a binary trace cannot be cut at
+    if (opt.binary && (opt.resume || opt.ckptEvery > 0)) return usage(argv[0]);
+    if (opt.interp) {
+        if (opt.ffCount > 0 || opt.resume || opt.ckptEvery > 0 || opt.profile || opt.folded || opt.binary ||
+            opt.filter.active() || opt.blockCache ||
+            (trace && strcmp(trace, "errors") != 0 && strcmp(trace, "none") != 0)) {
+            return usage(argv[0]);
         }
-        // lw, lh, lhu, lb, lbu
-        case 0x23: case 0x21: case 0x25: case 0x20: case 0x24: {
-            const int32_t Cext = SignExt16(C);
-            res = int32_t(rs_data) + Cext;
-            err |= isOverflow(rs_data, Cext, res);
-            EX_MEM.MemRead = true;
-            break;
-        }
-        default: { EX_MEM.RegWrite = false; }
-    }
-    EX_MEM.ALU_Result = res;
-    return err;
-}
-
-uint32_t J_execute() {
-    // jal
-    if (ID_EX.opcode == 0x03) {
-        EX_MEM.ALU_Result = ID_EX.jalPC;
-        EX_MEM.WriteDest = 31;
-        EX_MEM.RegWrite = true;
-    }
-    return 0;
+        return interpret(opt, trace == nullptr || strcmp(trace, "none") != 0);
+    }
+    if (trace == nullptr) trace = "full";
+    // the snapshot, the profile and checkpoints all need every cycle stepped
+    if (opt.blockCache && (strcmp(trace, "full") == 0 || strcmp(trace, "async") == 0 ||
+        opt.profile || opt.folded || opt.ckptEvery > 0)) {
+        return usage(argv[0]);
+    }
+    if (strcmp(trace, "full") == 0) return simulate<TraceFull>(opt);
+    if (strcmp(trace, "async") == 0) return simulate<TraceAsync>(opt);
+    if (strcmp(trace, "errors") == 0) return simulate<TraceErrorsOnly>(opt);
+    if (strcmp(trace, "none") == 0) return simulate<TraceNone>(opt);
+    fprintf(stderr, "pipeline: unknown trace policy %s\n", trace);
+    return 1;
 }
@@ -1,65 +1,187 @@
 #include "memory.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
-void memory::LoadInstr() {
-    FILE* image = fopen("iimage.bin", "rb");
-    int v;
-    fread(&v, sizeof(int), 1, image);
-    PC_ = PC0_ = ToBig(v);
-    fread(&v, sizeof(int), 1, image);
-    icount_ = ToBig(v);
-    for (size_t i = 0; i < icount_; ++i) {
-        fread(&v, sizeof(int), 1, image);
-        instr_[i] = ToBig(v);
+namespace {
+    // header of an image file: two big-endian words, then count words
+    struct image {
+        int fd = -1;
+        size_t size = 0;
+        uint32_t head = 0, count = 0;
+    };
+
+    // opens path and checks the count against the file size and capacity
+    bool openImage(const char* path, const uint64_t capacity, image& img) {
+        img.fd = open(path, O_RDONLY);
+        if (img.fd < 0) return false;
+        struct stat st;
+        uint32_t header[2];
+        int err = fstat(img.fd, &st) != 0 ? errno :
+            pread(img.fd, header, 8, 0) != 8 ? EINVAL : 0;
+        if (err != 0) {
+            close(img.fd);
+            errno = err;
+            return false;
+        }
+        img.size = st.st_size;
+        img.head = ToBig(header[0]);
+        img.count = ToBig(header[1]);
+        err = 8 + uint64_t(img.count) * 4 > img.size ? EINVAL :
+            img.count > capacity ? EFBIG : 0;
+        if (err != 0) {
+            close(img.fd);
+            errno = err;
+            return false;
+        }
+        return true;
+    }
+
+    // big-endian words to host order, a loop gcc turns into shuffles
+    void swapWords(uint32_t* dst, const uint8_t* src, const size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t v;
+            memcpy(&v, src + 4 * i, 4);
+            dst[i] = ToBig(v);
+        }
     }
-    fclose(image);
 }
 
-uint32_t memory::LoadData() {
-    FILE* image = fopen("dimage.bin", "rb");
-    int v;
-    fread(&v, sizeof(int), 1, image);
-    uint32_t SP = ToBig(v);
-    fread(&v, sizeof(int), 1, image);
-    dcount_ = ToBig(v);
-    for (size_t i = 0; i < 4 * dcount_; ++i) {
-        fread(&v, sizeof(char), 1, image);
-        data_[i] = ToBig(v) >> 24;
+bool memory::resize(const uint64_t isize, const uint64_t dsize) {
+    if (isize < 4 || dsize == 0 || isize > (uint64_t(1) << 32) || dsize > (uint64_t(1) << 32))
+        return false;
+    isize_ = isize;
+    dsize_ = dsize;
+    icount_ = dcount_ = 0;
+    instr_.clear();
+    predecode();
+    clearData();
+    pages_.assign((dsize + PAGE_SIZE - 1) >> PAGE_BITS, nullptr);
+    return true;
+}
+
+void memory::predecode() {
+    decoded_.resize(1 + icount_);
+    decoded_[0] = IR::Decoded();
+    for (size_t i = 0; i < icount_; ++i) {
+        decoded_[i + 1] = IR::decode(instr_[i]);
     }
-    fclose(image);
-    return SP;
 }
 
-const uint32_t memory::getInstr() const {
-    uint32_t ret = 0;
-    if (PC_ >= PC0_) ret = instr_[(PC_ - PC0_) / 4];
-    return ret;
+void memory::clearData() {
+    std::fill(pages_.begin(), pages_.end(), nullptr);
+    owned_.clear();
+    if (map_ != nullptr) munmap(map_, mapLen_);
+    map_ = nullptr;
+    mapLen_ = npages_ = 0;
+    lastPage_ = UINT32_MAX;
+    last_ = nullptr;
 }
 
-const uint32_t memory::loadWord(const size_t rhs) const {
-    return (data_[rhs] & 0xff) << 24 |
-            (data_[rhs + 1] & 0xff) << 16 |
-            (data_[rhs + 2] & 0xff) << 8 |
-            (data_[rhs + 3] & 0xff);
+bool memory::LoadInstr(const char* path) {
+    image img;
+    if (!openImage(path, isize_ / 4, img)) return false;
+    void* addr = mmap(nullptr, img.size, PROT_READ, MAP_PRIVATE, img.fd, 0);
+    close(img.fd);
+    if (addr == MAP_FAILED) return false;
+    PC_ = PC0_ = img.head;
+    icount_ = img.count;
+    instr_.resize(icount_);
+    swapWords(instr_.data(), static_cast<const uint8_t*>(addr) + 8, icount_);
+    munmap(addr, img.size);
+    predecode();
+    return true;
 }
-const uint32_t memory::loadHalfWord(const size_t rhs) const {
-    return (data_[rhs] & 0xff) << 8 | (data_[rhs + 1] & 0xff);
+
+void memory::LoadInstr(const uint32_t PC0, const uint32_t* words, const size_t n) {
+    PC_ = PC0_ = PC0;
+    icount_ = std::min<uint64_t>(n, isize_ / 4);
+    instr_.assign(words, words + icount_);
+    predecode();
 }
-const uint32_t memory::loadByte(const size_t rhs) const {
-    return data_[rhs];
+
+// the data words are already big-endian bytes as memory stores them, so
+// whole pages point into a private mapping and copy only when written
+bool memory::LoadData(uint32_t& SP, const char* path) {
+    image img;
+    if (!openImage(path, dsize_ / 4, img)) return false;
+    const size_t bytes = size_t(img.count) * 4,
+        npages = (bytes + PAGE_SIZE - 1) >> PAGE_BITS,
+        osPage = sysconf(_SC_PAGESIZE),
+        len = (8 + npages * PAGE_SIZE + osPage - 1) / osPage * osPage,
+        fileLen = (img.size + osPage - 1) / osPage * osPage;
+    clearData();
+    dcount_ = 0;
+    SP = img.head;
+    if (npages == 0) {
+        close(img.fd);
+        return true;
+    }
+    // zero-filled reservation, the file mapped over its start
+    void* addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr != MAP_FAILED && mmap(addr, std::min(fileLen, len), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_FIXED, img.fd, 0) == MAP_FAILED) {
+        munmap(addr, len);
+        addr = MAP_FAILED;
+    }
+    close(img.fd);
+    if (addr == MAP_FAILED) return false;
+    map_ = static_cast<uint8_t*>(addr);
+    mapLen_ = len;
+    // bytes past the last word are not data
+    const size_t end = std::min(img.size, 8 + npages * PAGE_SIZE);
+    if (end > 8 + bytes) memset(map_ + 8 + bytes, 0, end - 8 - bytes);
+    for (size_t i = 0; i < npages; ++i) pages_[i] = map_ + 8 + i * PAGE_SIZE;
+    npages_ = npages;
+    dcount_ = img.count;
+    return true;
 }
 
-void memory::saveWord(const size_t lhs, const uint32_t rhs) {
-    data_[lhs] = (rhs >> 24) & 0xff;
-    data_[lhs + 1] = (rhs >> 16) & 0xff;
-    data_[lhs + 2] = (rhs >> 8) & 0xff;
-    data_[lhs + 3] = rhs & 0xff;
+void memory::LoadData(const uint32_t* words, const size_t n) {
+    clearData();
+    dcount_ = std::min<uint64_t>(n, dsize_ / 4);
+    for (size_t i = 0; i < dcount_; ++i) {
+        saveWord(4 * i, words[i]);
+    }
 }
 
-void memory::saveHalfWord(const size_t lhs, const uint32_t rhs) {
-    data_[lhs] = (rhs >> 8) & 0xff;
-    data_[lhs + 1] = rhs & 0xff;
+const uint32_t memory::getInstr() const {
+    return decoded_[getSlot()].instr;
 }
 
-void memory::saveByte(const size_t lhs, const uint32_t rhs) {
-    data_[lhs] = rhs & 0xff;
+void memory::serialize(checkpoint& ckpt) {
+    uint64_t isize = isize_, dsize = dsize_;
+    ckpt.io(isize);
+    ckpt.io(dsize);
+    if (!ckpt.saving() && (!ckpt.ok() || !resize(isize, dsize))) return;
+    ckpt.io(PC_);
+    ckpt.io(PC0_);
+    ckpt.ioSize(icount_);
+    ckpt.ioSize(dcount_);
+    if (!ckpt.saving()) {
+        if (icount_ > isize_ / 4) icount_ = 0;
+        instr_.resize(icount_);
+    }
+    ckpt.io(instr_.data(), icount_);
+    if (!ckpt.saving()) predecode();
+    // touched pages only: count, then index and contents of each
+    size_t n = npages_;
+    ckpt.ioSize(n);
+    uint32_t idx = 0;
+    for (size_t i = 0; i < n && ckpt.ok(); ++i) {
+        if (ckpt.saving()) {
+            while (pages_[idx] == nullptr) ++idx;
+        }
+        ckpt.io(idx);
+        if (!ckpt.saving()) {
+            if (idx >= pages_.size()) return;
+            writePage(idx << PAGE_BITS);
+        }
+        ckpt.io(pages_[idx], PAGE_SIZE);
+        ++idx;
+    }
 }
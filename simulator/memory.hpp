@@ -1,23 +1,120 @@
 #pragma once
+#include <cstring>
 #include <fstream>
+#include <memory>
+#include <vector>
+#include "irfile.hpp"
+#include "checkpoint.hpp"
 #define ToBig(x) (__builtin_bswap32(x))
+#define ToBig16(x) (__builtin_bswap16(x))
+// default sizes in bytes
+#define INSTR_SIZE 4096
+#define DATA_SIZE 1024
+#define PAGE_BITS 12
+#define PAGE_SIZE (1u << PAGE_BITS)
 
 class memory {
 public:
-    void LoadInstr();
-    uint32_t LoadData();
+    memory() { resize(INSTR_SIZE, DATA_SIZE); }
+    ~memory() { clearData(); }
+    memory(const memory&) = delete;
+    memory& operator=(const memory&) = delete;
+    // sizes in bytes, data up to 4 GiB; clears both memories
+    bool resize(const uint64_t, const uint64_t);
+    const uint64_t getInstrSize() const { return isize_; }
+    const uint64_t getDataSize() const { return dsize_; }
+    // images are mapped and validated: a truncated image or one larger
+    // than the memory fails with errno EINVAL or EFBIG
+    bool LoadInstr(const char* path = "iimage.bin");
+    void LoadInstr(const uint32_t, const uint32_t*, const size_t);
+    // returns the initial $sp, or false if the image cannot be read
+    bool LoadData(uint32_t&, const char* path = "dimage.bin");
+    void LoadData(const uint32_t*, const size_t);
     const uint32_t& getPC() const { return PC_; }
+    const uint32_t& getPC0() const { return PC0_; }
+    // words in the instruction image, slots 1 to this
+    const size_t getInstrCount() const { return icount_; }
     void setPC(const uint32_t& rhs) { PC_ = rhs; }
     const uint32_t getInstr() const;
-    const uint32_t loadWord(const size_t) const;
-    const uint32_t loadHalfWord(const size_t) const;
-    const uint32_t loadByte(const size_t) const;
-    void saveWord(const size_t, const uint32_t);
-    void saveHalfWord(const size_t, const uint32_t);
-    void saveByte(const size_t, const uint32_t);
+    // slot of PC in the predecoded table, 0 is the NOP bubble
+    const uint32_t getSlot() const { return getSlot(PC_); }
+    const uint32_t getSlot(const uint32_t pc) const {
+        const uint32_t idx = (pc - PC0_) / 4;
+        return pc >= PC0_ && idx < icount_ ? idx + 1 : 0;
+    }
+    const IR::Decoded& getDecoded(const uint32_t slot) const { return decoded_[slot]; }
+    // size bytes at addr lie inside data memory
+    bool inBounds(const uint32_t addr, const uint32_t size) const {
+        return addr + uint64_t(size) <= dsize_;
+    }
+    // data is big-endian, accesses are checked and aligned by the caller
+    // so none of them crosses a page
+    const uint32_t loadWord(const uint32_t rhs) const {
+        uint32_t v;
+        memcpy(&v, readPage(rhs) + (rhs & (PAGE_SIZE - 1)), 4);
+        return ToBig(v);
+    }
+    const uint32_t loadHalfWord(const uint32_t rhs) const {
+        uint16_t v;
+        memcpy(&v, readPage(rhs) + (rhs & (PAGE_SIZE - 1)), 2);
+        return ToBig16(v);
+    }
+    const uint32_t loadByte(const uint32_t rhs) const {
+        return readPage(rhs)[rhs & (PAGE_SIZE - 1)];
+    }
+    void saveWord(const uint32_t lhs, const uint32_t rhs) {
+        const uint32_t v = ToBig(rhs);
+        memcpy(writePage(lhs) + (lhs & (PAGE_SIZE - 1)), &v, 4);
+    }
+    void saveHalfWord(const uint32_t lhs, const uint32_t rhs) {
+        const uint16_t v = ToBig16(uint16_t(rhs));
+        memcpy(writePage(lhs) + (lhs & (PAGE_SIZE - 1)), &v, 2);
+    }
+    void saveByte(const uint32_t lhs, const uint32_t rhs) {
+        writePage(lhs)[lhs & (PAGE_SIZE - 1)] = rhs;
+    }
+    // pages touched so far
+    const size_t getPageCount() const { return npages_; }
+    void serialize(checkpoint&);
 
 private:
+    // untouched pages read as zero and are allocated on the first store
+    const uint8_t* readPage(const uint32_t addr) const {
+        const uint32_t n = addr >> PAGE_BITS;
+        if (n == lastPage_) return last_;
+        if (pages_[n] == nullptr) return zeroPage();
+        lastPage_ = n;
+        return last_ = pages_[n];
+    }
+    uint8_t* writePage(const uint32_t addr) {
+        const uint32_t n = addr >> PAGE_BITS;
+        if (n == lastPage_) return last_;
+        if (pages_[n] == nullptr) {
+            owned_.emplace_back(new uint8_t[PAGE_SIZE]());
+            pages_[n] = owned_.back().get();
+            ++npages_;
+        }
+        lastPage_ = n;
+        return last_ = pages_[n];
+    }
+    static const uint8_t* zeroPage() {
+        static const uint8_t zero[PAGE_SIZE] = {};
+        return zero;
+    }
+    void predecode();
+    void clearData();
+
     uint32_t PC_ = 0, PC0_ = 0;
-    size_t icount_ = 0, dcount_ = 0;
-    uint32_t instr_[1024] = {}, data_[4096] = {};
+    uint64_t isize_ = 0, dsize_ = 0;
+    size_t icount_ = 0, dcount_ = 0, npages_ = 0;
+    std::vector<uint32_t> instr_;
+    std::vector<IR::Decoded> decoded_;
+    // a page is either heap-owned or points into the private data image mapping
+    std::vector<uint8_t*> pages_;
+    std::vector<std::unique_ptr<uint8_t[]>> owned_;
+    uint8_t* map_ = nullptr;
+    size_t mapLen_ = 0;
+    // one-entry cache of the last page touched, never the zero page
+    mutable uint32_t lastPage_ = UINT32_MAX;
+    mutable uint8_t* last_ = nullptr;
 };
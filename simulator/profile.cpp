@@ -0,0 +1,72 @@
+#include "profile.hpp"
+#include <algorithm>
+
+namespace {
+    bool endsBlock(const IR::Decoded& d) {
+        return d.type == 'J' || d.type == 'S' || d.op == IR::OP_JR ||
+            d.op == IR::OP_BEQ || d.op == IR::OP_BNE || d.op == IR::OP_BGTZ;
+    }
+
+    const char* opName(const IR::Decoded& d) {
+        const char* name = IR::Ops[d.op].name;
+        return name[0] ? name : "?";
+    }
+
+    uint32_t pcOf(const memory& mem, const uint32_t slot) { return mem.getPC0() + 4 * (slot - 1); }
+}
+
+// split after every branch, jump and HALT and before every taken target
+std::vector<profile::Block> profile::blocks(const memory& mem) const {
+    std::vector<Block> out;
+    for (uint32_t slot = 1; slot < at_.size(); ++slot) {
+        if (slot == 1 || at_[slot].target || endsBlock(mem.getDecoded(slot - 1))) {
+            out.push_back({slot, slot, 0, 0, 0});
+        }
+        Block& b = out.back();
+        b.last = slot;
+        b.cycles += at_[slot].cycles + at_[slot].flushes;
+        b.stalls += at_[slot].stalls;
+        b.flushes += at_[slot].flushes;
+    }
+    return out;
+}
+
+void profile::print(FILE* f, const memory& mem, const size_t top) const {
+    if (!enabled()) return;
+    size_t total = 0;
+    for (const auto& e : at_) total += e.cycles;
+    std::vector<Block> hot = blocks(mem);
+    std::stable_sort(hot.begin(), hot.end(),
+        [](const Block& a, const Block& b) { return a.cycles > b.cycles; });
+    fprintf(f, "%zu cycles, charged to the instruction in ID; a flush costs its branch one more\n", total);
+    for (size_t i = 0; i < hot.size() && i < top && hot[i].cycles > 0; ++i) {
+        const Block& b = hot[i];
+        // entries into the block: cycles its first instruction spent in ID unstalled
+        const Entry& head = at_[b.first];
+        fprintf(f, "\n#%zu 0x%08X-0x%08X  %zu cycles (%.1f%%)  %zu runs  %zu stalls  %zu flushes\n",
+            i + 1, pcOf(mem, b.first), pcOf(mem, b.last), b.cycles,
+            total ? 100.0 * b.cycles / total : 0.0, head.cycles - head.stalls, b.stalls, b.flushes);
+        for (uint32_t slot = b.first; slot <= b.last; ++slot) {
+            const IR::Decoded& d = mem.getDecoded(slot);
+            const Entry& e = at_[slot];
+            fprintf(f, "    0x%08X  %08X  %-6s %10zu %8zu %8zu\n",
+                pcOf(mem, slot), d.instr, opName(d), e.cycles, e.stalls, e.flushes);
+        }
+    }
+}
+
+void profile::printFolded(FILE* f, const memory& mem) const {
+    if (!enabled()) return;
+    // bubbles in ID other than flushes, which go to their branch
+    size_t bubbles = at_[0].cycles;
+    for (const auto& e : at_) bubbles -= std::min(bubbles, e.flushes);
+    if (bubbles > 0) fprintf(f, "bubble %zu\n", bubbles);
+    for (const Block& b : blocks(mem)) {
+        for (uint32_t slot = b.first; slot <= b.last; ++slot) {
+            const size_t n = at_[slot].cycles + at_[slot].flushes;
+            if (n == 0) continue;
+            fprintf(f, "0x%08X;0x%08X_%s %zu\n", pcOf(mem, b.first), pcOf(mem, slot),
+                opName(mem.getDecoded(slot)), n);
+        }
+    }
+}
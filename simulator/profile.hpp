@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+#include "memory.hpp"
+
+// per-PC guest profile: a flat array over the predecoded slots, so
+// entry i + 1 is the instruction at PC0 + 4i and entry 0 the bubble
+class profile {
+public:
+    // one entry per instruction word, empty when profiling is off
+    void reset(const size_t words) { at_.assign(words + 1, Entry()); }
+    const bool enabled() const { return !at_.empty(); }
+    // a cycle with slot in ID; target is where a flush sent IF
+    void charge(const uint32_t slot, const bool stall, const bool flush, const uint32_t target) {
+        Entry& e = at_[slot];
+        ++e.cycles;
+        e.stalls += stall;
+        if (flush) {
+            ++e.flushes;
+            at_[target].target = true;
+        }
+    }
+    // the top hottest basic blocks with their instructions
+    void print(FILE*, const memory&, const size_t top) const;
+    // block;instruction count, for flame-graph tools
+    void printFolded(FILE*, const memory&) const;
+
+private:
+    struct Entry {
+        size_t cycles = 0, stalls = 0, flushes = 0; // flushes: bubbles this one caused
+        bool target = false; // a taken branch or jump landed here
+    };
+    struct Block {
+        uint32_t first, last; // slots
+        size_t cycles, stalls, flushes;
+    };
+    std::vector<Block> blocks(const memory&) const;
+    std::vector<Entry> at_;
+};
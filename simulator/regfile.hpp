@@ -1,4 +1,6 @@
 #pragma once
+#include "checkpoint.hpp"
+
 class regfile {
 public:
     regfile() {}
@@ -31,6 +33,19 @@ public:
         HILOlock_ = true;
         return ret;
     }
+    const bool& getHILOlock() const { return HILOlock_; }
+    // put back HI, LO and the lock as they were before setHILO or a fetch
+    void restoreHILO(const uint32_t& hi, const uint32_t& lo, const bool lock) {
+        HI_ = hi;
+        LO_ = lo;
+        HILOlock_ = lock;
+    }
+    void serialize(checkpoint& ckpt) {
+        ckpt.io(reg_, 32);
+        ckpt.io(HI_);
+        ckpt.io(LO_);
+        ckpt.io(HILOlock_);
+    }
 
 private:
     uint32_t reg_[32] = {}, HI_ = 0, LO_ = 0;
@@ -0,0 +1,171 @@
+#include "report.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+namespace {
+    // "00" "01" ... "FF"
+    struct HexTable {
+        HexTable() {
+            const char* digits = "0123456789ABCDEF";
+            for (int i = 0; i < 256; ++i) {
+                pair[2 * i] = digits[i >> 4];
+                pair[2 * i + 1] = digits[i & 0xf];
+            }
+        }
+        char pair[512];
+    };
+    const HexTable hex;
+}
+
+bool report::open(const char* path, const bool direct, const size_t offset) {
+    close();
+    direct_ = false;
+    error_ = 0;
+    const int flags = O_WRONLY | O_CREAT | (offset == 0 ? O_TRUNC : 0);
+#ifdef O_DIRECT
+    if (direct) {
+        fd_ = ::open(path, flags | O_DIRECT, 0644);
+        direct_ = fd_ >= 0;
+    }
+#endif
+    if (fd_ < 0) fd_ = ::open(path, flags, 0644);
+    if (fd_ < 0) return false;
+    void* p = nullptr;
+    if (posix_memalign(&p, kAlign, kCap) != 0) {
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    buf_ = static_cast<char*>(p);
+    len_ = written_ = 0;
+    // keep the first offset bytes, or nothing if the file is shorter
+    size_t keep = 0;
+    struct stat st;
+    // a pipe or FIFO, as pipeline-difftest hands out, is written as a stream
+    const bool known = fstat(fd_, &st) == 0, stream = known && !S_ISREG(st.st_mode);
+    if (offset > 0 && known && !stream && size_t(st.st_size) >= offset) keep = offset;
+    if (!stream && ftruncate(fd_, keep) != 0) {
+        close();
+        return false;
+    }
+    // O_DIRECT writes must start on a block boundary: reload the partial block
+    written_ = direct_ ? keep - keep % kAlign : keep;
+    len_ = keep - written_;
+    if (len_ > 0) {
+        const int in = ::open(path, O_RDONLY);
+        const bool loaded = in >= 0 && pread(in, buf_, len_, written_) == ssize_t(len_);
+        if (in >= 0) ::close(in);
+        if (!loaded) {
+            written_ = len_ = 0;
+            if (ftruncate(fd_, 0) != 0) {
+                close();
+                return false;
+            }
+        }
+    }
+    lseek(fd_, written_, SEEK_SET);
+    return true;
+}
+
+bool report::close() {
+    if (fd_ >= 0) {
+        flush();
+#ifdef O_DIRECT
+        // the unaligned tail cannot go through O_DIRECT
+        if (direct_ && len_ > 0) {
+            fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+            direct_ = false;
+            flush();
+        }
+#endif
+        if (::close(fd_) != 0 && error_ == 0) error_ = errno;
+        fd_ = -1;
+        free(buf_);
+        buf_ = nullptr;
+        len_ = written_ = 0;
+    }
+    if (error_ == 0) return true;
+    errno = error_;
+    return false;
+}
+
+// put the buffered tail on disk without giving up the O_DIRECT alignment
+bool report::sync() {
+    flush();
+    bool ok = true;
+#ifdef O_DIRECT
+    if (direct_ && len_ > 0) {
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+        ok = pwrite(fd_, buf_, len_, written_) == ssize_t(len_);
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_DIRECT);
+        if (!ok && error_ == 0) error_ = errno;
+    }
+#endif
+    return ok && error_ == 0;
+}
+
+void report::flush() {
+    size_t n = len_;
+    if (direct_) n -= n % kAlign;
+    if (n == 0) return;
+    writeAll(buf_, n);
+    memmove(buf_, buf_ + n, len_ - n);
+    len_ -= n;
+}
+
+void report::putHex(const uint32_t v) {
+    if (len_ + 8 > kCap) flush();
+    char* p = buf_ + len_;
+    memcpy(p, hex.pair + 2 * (v >> 24), 2);
+    memcpy(p + 2, hex.pair + 2 * ((v >> 16) & 0xff), 2);
+    memcpy(p + 4, hex.pair + 2 * ((v >> 8) & 0xff), 2);
+    memcpy(p + 6, hex.pair + 2 * (v & 0xff), 2);
+    len_ += 8;
+}
+
+void report::putDec(size_t v, const int width) {
+    char tmp[24];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    while (n < width) tmp[n++] = '0';
+    if (len_ + n > kCap) flush();
+    while (n > 0) buf_[len_++] = tmp[--n];
+}
+
+// hand a large block to the kernel together with the pending buffer
+void report::putLarge(const char* s, const size_t n) {
+    iovec iov[2] = {{buf_, len_}, {const_cast<char*>(s), n}};
+    size_t total = len_ + n;
+    ssize_t w = writev(fd_, iov, 2);
+    if (w < 0) w = 0;
+    written_ += w;
+    if (size_t(w) < len_) {
+        writeAll(buf_ + w, len_ - w);
+        writeAll(s, n);
+    } else if (size_t(w) < total) {
+        writeAll(s + (w - len_), total - w);
+    }
+    len_ = 0;
+}
+
+void report::writeAll(const char* p, size_t n) {
+    while (n > 0) {
+        const ssize_t w = write(fd_, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) {
+            // the rest is dropped, close() reports it
+            if (error_ == 0) error_ = w < 0 ? errno : EIO;
+            return;
+        }
+        p += w;
+        n -= w;
+        written_ += w;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// buffered report writer, appends without format parsing
+class report {
+public:
+    report() {}
+    report(const report&) = delete;
+    report& operator=(const report&) = delete;
+    ~report() { close(); }
+    // direct: bypass the page cache with O_DIRECT where supported
+    // offset: keep that many bytes of an existing file and append after them
+    bool open(const char*, const bool direct = false, const size_t offset = 0);
+    // false if a write since open failed, errno set to the first error
+    bool close();
+    void flush();
+    bool sync();
+    void put(const char* s, const size_t n) {
+        if (len_ + n > kCap) {
+            if (!direct_ && n >= kCap / 2) return putLarge(s, n);
+            flush();
+        }
+        memcpy(buf_ + len_, s, n);
+        len_ += n;
+    }
+    void put(const char* s) { put(s, strlen(s)); }
+    void put(const char c) {
+        if (len_ + 1 > kCap) flush();
+        buf_[len_++] = c;
+    }
+    // 8 upper-case hex digits, as %08X
+    void putHex(const uint32_t);
+    // decimal, at least width digits zero-padded, as %0*zu
+    void putDec(size_t, const int width = 1);
+    const size_t tell() const { return written_ + len_; }
+    const bool isOpen() const { return fd_ >= 0; }
+
+private:
+    static const size_t kCap = 1 << 20, kAlign = 4096;
+    void putLarge(const char*, const size_t);
+    void writeAll(const char*, size_t);
+    int fd_ = -1;
+    char* buf_ = nullptr;
+    size_t len_ = 0, written_ = 0;
+    bool direct_ = false;
+    int error_ = 0; // errno of the first failed write
+};
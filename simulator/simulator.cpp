@@ -0,0 +1,975 @@
+#include "simulator.hpp"
+
+template <class Trace>
+bool Simulator<Trace>::loadImages(const char* iimage, const char* dimage) {
+    uint32_t SP;
+    if (!mem.LoadInstr(iimage) || !mem.LoadData(SP, dimage)) return false;
+    reg.setReg(29, SP);
+    return true;
+}
+
+template <class Trace>
+void Simulator<Trace>::loadImages(const uint32_t PC0, const uint32_t* instr, const size_t icount,
+    const uint32_t SP, const uint32_t* data, const size_t dcount)
+{
+    mem.LoadInstr(PC0, instr, icount);
+    mem.LoadData(data, dcount);
+    reg.setReg(29, SP);
+}
+
+template <class Trace>
+bool Simulator<Trace>::openReports(const char* snapshot_path, const char* error_dump_path, const bool direct) {
+    if (!Trace::errors) return true;
+    if (!snapshot.open(snapshot_path, direct, Trace::snapshot ? snapOff_ : 0) ||
+        !error_dump.open(error_dump_path, direct, errOff_)) return false;
+    // a copied checkpoint comes without its reports: restart them here
+    if ((Trace::snapshot && snapshot.tell() != snapOff_) || error_dump.tell() != errOff_) full_ = true;
+    if (binary_) tracer_.setBinary();
+    if (Trace::async) tracer_.start();
+    return true;
+}
+
+template <class Trace>
+bool Simulator<Trace>::closeReports() {
+    if (!Trace::snapshot && snapshot.isOpen()) {
+        traceRegs(true);
+        rec_.kind = TraceRecord::HEAD;
+        tracer_.put(rec_);
+    }
+    tracer_.stop();
+    tracer_.finish();
+    // both closed whatever the first returns
+    const bool wrote = snapshot.close();
+    return error_dump.close() && wrote;
+}
+
+template <class Trace>
+bool Simulator<Trace>::step() {
+    if (status_ != RUNNING) return false;
+    dumpErrors();
+    if (err_ & HALT) {
+        status_ = ERROR;
+        return false;
+    }
+    const bool emit = Trace::snapshot && snapshot.isOpen() && (!filtered_ || traced());
+    if (emit) traceRegs(full_);
+    // a cycle left out breaks the chain of register deltas
+    full_ = Trace::snapshot && filtered_ && !emit;
+    uint32_t err = 0;
+    err |= WB();
+    err |= MEM();
+    err |= EX();
+    const uint32_t instr = mem.getInstr();
+    err |= ID();
+    if (err & ERR_ILLEGAL) {
+        // the block ends before IF, without stage lines
+        if (emit) {
+            rec_.kind = TraceRecord::HEAD;
+            tracer_.put(rec_);
+        }
+        status_ = ILLEGAL;
+        return false;
+    }
+    // ID has decided this cycle's stall and flush, IF has not consumed them
+    if (prof_.enabled()) prof_.charge(IF_ID[cur_].slot, stall, flush, mem.getSlot());
+    err |= IF();
+    // the latches written this cycle become the ones read next cycle
+    cur_ ^= 1;
+    if (emit) {
+        rec_.kind = TraceRecord::CYCLE;
+        rec_.c.instr = instr;
+        tracer_.put(rec_);
+    }
+    err_ = err;
+    if (halted()) {
+        status_ = HALTED;
+        return false;
+    }
+    if (cycle_ == limit_) {
+        status_ = LIMIT;
+        return false;
+    }
+    ++cycle_;
+    return true;
+}
+
+template <class Trace>
+SimulatorBase::Status Simulator<Trace>::run() {
+    if (!cached_ || Trace::snapshot || prof_.enabled()) {
+        while (step()) {}
+        return status_;
+    }
+    while (status_ == RUNNING) {
+        if (!(err_ & HALT) && blocks_.find(controlState()) != nullptr) runBlocks();
+        if (status_ == RUNNING) recordBlock();
+    }
+    return status_;
+}
+
+// the errors raised in the previous cycle
+template <class Trace>
+void Simulator<Trace>::dumpErrors() {
+    if (Trace::errors && err_ != 0 && error_dump.isOpen()) {
+        TraceRecord r;
+        r.kind = TraceRecord::ERRORS;
+        r.cycle = cycle_;
+        r.err = err_;
+        tracer_.put(r);
+    }
+}
+
+// the trace filter at the top of the cycle: the writes WB and DM are about
+// to make are already latched
+template <class Trace>
+bool Simulator<Trace>::traced() {
+    if (cycle_ < filter_.from || cycle_ > filter_.to) return false;
+    if (mem.getPC() < filter_.pcLo || mem.getPC() >= filter_.pcHi) return false;
+    if (!filter_.watching()) return true;
+    const EXMEM_Buffer& store = EX_MEM[cur_];
+    const uint32_t width = IR::Ops[mem.getDecoded(store.slot).op].width;
+    if ((MEM_WB[cur_].destMask() & filter_.regs) ||
+        (store.MemWrite && store.WriteDest < filter_.addrHi && store.WriteDest + uint64_t(width) > filter_.addrLo))
+        watchEnd_ = cycle_ + filter_.window + 1;
+    return cycle_ < watchEnd_;
+}
+
+// HALT in IF and in every stage of the cycle just run, none of them stalled
+template <class Trace>
+bool Simulator<Trace>::halted() const {
+    return mem.getDecoded(IF_ID[cur_].slot).op == IR::OP_HALT &&
+        mem.getDecoded(ID_EX[cur_].slot).op == IR::OP_HALT &&
+        mem.getDecoded(EX_MEM[cur_].slot).op == IR::OP_HALT &&
+        mem.getDecoded(MEM_WB[cur_].slot).op == IR::OP_HALT &&
+        mem.getDecoded(MEM_WB[cur_ ^ 1].slot).op == IR::OP_HALT;
+}
+
+/**
+* Reports
+*/
+
+// the top of a cycle block: every register, or those WB and EX changed
+// in the previous cycle, and the PC
+template <class Trace>
+void Simulator<Trace>::traceRegs(const bool full) {
+    rec_.cycle = cycle_;
+    rec_.full = full;
+    if (full) {
+        uint32_t regs[34];
+        for (int i = 0; i < 32; ++i) regs[i] = reg.getReg(i);
+        regs[32] = reg.getHI();
+        regs[33] = reg.getLO();
+        tracer_.putRegs(regs, cycle_);
+    } else {
+        // the latch WB consumed and the one EX wrote in the previous cycle
+        const MEMWB_Buffer& wb = MEM_WB[cur_ ^ 1];
+        rec_.dest = wb.RegPrint ? wb.WriteDest : 0;
+        rec_.c.value = wb.rt_data;
+        rec_.hilo = EX_MEM[cur_].isHILO;
+        rec_.c.HI = reg.getHI();
+        rec_.c.LO = reg.getLO();
+    }
+    rec_.c.PC = mem.getPC();
+}
+
+/**
+* Five Stages
+*/
+
+template <class Trace>
+uint32_t Simulator<Trace>::WB() {
+    MEMWB_Buffer& in = MEM_WB[cur_];
+    const uint8_t op = mem.getDecoded(in.slot).op;
+    if (Trace::snapshot) rec_.stages[4] = StageLabel(op);
+    if (in.slot != 0 && op != IR::OP_HALT) ++retired_;
+    const uint32_t dest = in.WriteDest, data = in.rt_data;
+    // print iff changed
+    in.RegPrint = Trace::snapshot && in.RegWrite && dest != 0 && reg.getReg(dest) != data;
+    if (in.RegWrite) {
+        if (dest == 0) return ERR_WRITE_REG_ZERO;
+        else reg.setReg(dest, data);
+    }
+    return 0;
+}
+
+template <class Trace>
+uint32_t Simulator<Trace>::MEM() {
+    const EXMEM_Buffer& in = EX_MEM[cur_];
+    MEMWB_Buffer& out = MEM_WB[cur_ ^ 1];
+    const IR::Decoded& d = mem.getDecoded(in.slot);
+    if (Trace::snapshot) rec_.stages[3] = StageLabel(d.op);
+    out.slot = in.slot;
+    out.rt_data = in.ALU_Result;
+    out.WriteDest = in.WriteDest;
+    out.RegWrite = in.RegWrite;
+    out.RegPrint = false;
+    return (this->*handlers_.mem[d.op])(d);
+}
+
+template <class Trace>
+uint32_t Simulator<Trace>::EX() {
+    // forwarded operands replace the ones ID latched
+    IDEX_Buffer& in = ID_EX[cur_];
+    const EXMEM_Buffer& exmem = EX_MEM[cur_];
+    const MEMWB_Buffer& memwb = MEM_WB[cur_];
+    EXMEM_Buffer& out = EX_MEM[cur_ ^ 1];
+    const IR::Decoded& d = mem.getDecoded(in.slot);
+    if (Trace::snapshot) rec_.stages[2] = StageLabel(d.op);
+    out.slot = in.slot;
+    // fwd_EX-DM, fwd_DM-WB: the nearer writer wins
+    const uint32_t exDest = exmem.destMask(), wbDest = memwb.destMask();
+    if (exDest & d.srcRs) {
+        in.rs_data = exmem.ALU_Result;
+        ++events_.fwdExDmRs;
+        if (Trace::snapshot) {
+            rec_.stages[2].note |= NOTE_FWD_EXDM_RS;
+            rec_.stages[2].rs = d.rs;
+        }
+    } else if (wbDest & d.srcRs) {
+        in.rs_data = memwb.rt_data;
+        ++events_.fwdDmWbRs;
+        if (Trace::snapshot) {
+            rec_.stages[2].note |= NOTE_FWD_DMWB_RS;
+            rec_.stages[2].rs = d.rs;
+        }
+    }
+    if (exDest & d.srcRt) {
+        in.rt_data = exmem.ALU_Result;
+        ++events_.fwdExDmRt;
+        if (Trace::snapshot) {
+            rec_.stages[2].note |= NOTE_FWD_EXDM_RT;
+            rec_.stages[2].rt = d.rt;
+        }
+    } else if (wbDest & d.srcRt) {
+        in.rt_data = memwb.rt_data;
+        ++events_.fwdDmWbRt;
+        if (Trace::snapshot) {
+            rec_.stages[2].note |= NOTE_FWD_DMWB_RT;
+            rec_.stages[2].rt = d.rt;
+        }
+    }
+    out.MemWrite = out.MemRead = out.RegWrite = false;
+    out.isHILO = 0;
+    return (this->*handlers_.ex[d.op])(d);
+}
+
+template <class Trace>
+uint32_t Simulator<Trace>::ID() {
+    // EX and DM have already written their latches this cycle
+    const IFID_Buffer& in = IF_ID[cur_];
+    const EXMEM_Buffer& exmem = EX_MEM[cur_ ^ 1];
+    const MEMWB_Buffer& memwb = MEM_WB[cur_ ^ 1];
+    IDEX_Buffer& out = ID_EX[cur_ ^ 1];
+    const IR::Decoded& d = mem.getDecoded(in.slot);
+    if (Trace::snapshot) rec_.stages[1] = StageLabel(d.op);
+    // stall: load-use
+    if (mem.getDecoded(ID_EX[cur_].slot).load & d.src) stall = true;
+    if (stall) {
+        ++events_.loadUseStalls;
+        if (Trace::snapshot) rec_.stages[1].note |= NOTE_STALLED;
+        out.slot = 0;
+        out.rs_data = out.rt_data = 0;
+        return 0;
+    }
+    // ID
+    out.slot = in.slot;
+    switch (d.type) {
+        case 'R': {
+            out.rs_data = reg.getReg(d.rs);
+            out.rt_data = reg.getReg(d.rt);
+            // jr
+            if (d.op == IR::OP_JR) {
+                // stall: rs in EX, or a load in DM
+                if ((exmem.destMask() | mem.getDecoded(memwb.slot).load) & d.rsMask) {
+                    stall = true;
+                    ++events_.branchStalls;
+                    if (Trace::snapshot) rec_.stages[1].note |= NOTE_STALLED;
+                    out.slot = 0;
+                    out.rs_data = out.rt_data = 0;
+                    return 0;
+                }
+                // fwd_EX-DM
+                if (memwb.destMask() & d.rsMask) {
+                    out.rs_data = memwb.rt_data;
+                    ++events_.fwdExDmRs;
+                    if (Trace::snapshot) {
+                        rec_.stages[1].note |= NOTE_FWD_EXDM_RS;
+                        rec_.stages[1].rs = d.rs;
+                    }
+                }
+                flush = true;
+                ++events_.jumpFlushes;
+                mem.setPC(out.rs_data);
+            }
+            break;
+        }
+        case 'I': {
+            out.rs_data = reg.getReg(d.rs);
+            out.rt_data = reg.getReg(d.rt);
+            // beq, bne, bgtz (signed)
+            if (d.op == IR::OP_BEQ || d.op == IR::OP_BNE || d.op == IR::OP_BGTZ) {
+                // {14'{C[15]}, C, 2'b0}
+                const uint32_t Caddr = d.imm << 2;
+                // bgtz reads no rt, but a load in DM still stalls it on the rt field
+                const uint32_t rt = d.op != IR::OP_BGTZ ? d.rtMask : 0;
+                if ((exmem.destMask() & (d.rsMask | rt)) ||
+                    (mem.getDecoded(memwb.slot).load & (d.rsMask | d.rtMask))) {
+                    stall = true;
+                    ++events_.branchStalls;
+                    if (Trace::snapshot) rec_.stages[1].note |= NOTE_STALLED;
+                    out.slot = 0;
+                    out.rs_data = out.rt_data = 0;
+                    return 0;
+                }
+                // fwd_EX-DM
+                const uint32_t wbDest = memwb.destMask();
+                if (wbDest & d.rsMask) {
+                    out.rs_data = memwb.rt_data;
+                    ++events_.fwdExDmRs;
+                    if (Trace::snapshot) {
+                        rec_.stages[1].note |= NOTE_FWD_EXDM_RS;
+                        rec_.stages[1].rs = d.rs;
+                    }
+                }
+                if (wbDest & rt) {
+                    out.rt_data = memwb.rt_data;
+                    ++events_.fwdExDmRt;
+                    if (Trace::snapshot) {
+                        rec_.stages[1].note |= NOTE_FWD_EXDM_RT;
+                        rec_.stages[1].rt = d.rt;
+                    }
+                }
+                if ((d.op == IR::OP_BEQ && out.rs_data == out.rt_data) ||
+                    (d.op == IR::OP_BNE && out.rs_data != out.rt_data) ||
+                    (d.op == IR::OP_BGTZ && int32_t(out.rs_data) > 0))
+                {
+                    flush = true;
+                    ++events_.branchFlushes;
+                    mem.setPC(mem.getPC() + Caddr);
+                }
+            }
+            break;
+        }
+        case 'J': {
+            out.jalPC = mem.getPC();
+            // j && jal: PC = {(PC+4)[31:28], C, 2'b0}
+            flush = true;
+            ++events_.jumpFlushes;
+            mem.setPC((mem.getPC() & 0xf0000000) | (d.C << 2));
+            break;
+        }
+        case 'S': {
+            break;
+        }
+        default: {
+            return ERR_ILLEGAL;
+        }
+    }
+    return 0;
+}
+
+template <class Trace>
+uint32_t Simulator<Trace>::IF() {
+    if (Trace::snapshot) rec_.stages[0] = StageLabel();
+    // stall
+    IFID_Buffer& out = IF_ID[cur_ ^ 1];
+    if (stall) {
+        if (Trace::snapshot) rec_.stages[0].note = NOTE_STALLED;
+        out.slot = IF_ID[cur_].slot;
+        stall = false;
+        return 0;
+    }
+    // flush
+    if (flush) {
+        if (Trace::snapshot) rec_.stages[0].note = NOTE_FLUSHED;
+        out.slot = 0;
+        flush = false;
+        return 0;
+    }
+    out.slot = mem.getSlot();
+    mem.setPC(mem.getPC() + 4);
+    return 0;
+}
+
+/**
+* EX and MEM handlers
+* one instantiation per Op, specialised by its row in IR::Ops, and
+* dispatched through handlers_
+*/
+
+template <class Trace>
+template <size_t O>
+uint32_t Simulator<Trace>::exOp(const IR::Decoded& d) {
+    constexpr IR::OpInfo op = IR::Ops[O];
+    if (op.type == 'S' || op.type == 'F') return 0;
+    const IDEX_Buffer& in = ID_EX[cur_];
+    EXMEM_Buffer& out = EX_MEM[cur_ ^ 1];
+    if (op.type == 'J') {
+        if (op.alu == IR::ALU_LINK) {
+            out.ALU_Result = in.jalPC;
+            out.WriteDest = 31;
+            out.RegWrite = true;
+        }
+        return 0;
+    }
+    const uint32_t& rs_data = in.rs_data,
+            rt_data = in.rt_data;
+    const uint32_t b = op.type == 'I' ? d.imm : rt_data;
+    uint32_t res = 0, err = 0;
+    out.WriteDest = op.type == 'R' ? d.rd : d.rt;
+    out.RegWrite = op.writes;
+    switch (op.alu) {
+        case IR::ALU_ADD: {
+            res = rs_data + b;
+            if (op.overflow) err |= isOverflow(rs_data, b, res);
+            break;
+        }
+        case IR::ALU_SUB: {
+            res = rs_data - b;
+            if (op.overflow) err |= isSubOverflow(rs_data, b, res);
+            break;
+        }
+        case IR::ALU_AND: { res = rs_data & b; break; }
+        case IR::ALU_OR: { res = rs_data | b; break; }
+        case IR::ALU_XOR: { res = rs_data ^ b; break; }
+        case IR::ALU_NOR: { res = ~(rs_data | b); break; }
+        case IR::ALU_NAND: { res = ~(rs_data & b); break; }
+        case IR::ALU_SLT: { res = int32_t(rs_data) < int32_t(b) ? 1 : 0; break; }
+        case IR::ALU_SLL: { res = rt_data << d.shamt; break; }
+        case IR::ALU_SRL: { res = rt_data >> d.shamt; break; }
+        case IR::ALU_SRA: { res = int32_t(rt_data) >> d.shamt; break; }
+        case IR::ALU_MFHI: { res = reg.fetchHI(); break; }
+        case IR::ALU_MFLO: { res = reg.fetchLO(); break; }
+        case IR::ALU_LUI: { res = b; break; }
+        case IR::ALU_MULT: case IR::ALU_MULTU: {
+            const uint64_t m = op.alu == IR::ALU_MULT ?
+                uint64_t(SignExt32(rs_data) * SignExt32(rt_data)) : uint64_t(rs_data) * uint64_t(rt_data);
+            const uint32_t HI = m >> 32, LO = m & 0x00000000ffffffff;
+            if (Trace::snapshot)
+                out.isHILO = (HI == reg.getHI() ? 0x0 : 0x01) | (LO == reg.getLO() ? 0x0 : 0x10);
+            return reg.setHILO(HI, LO) ? ERR_OVERWRTIE_REG_HI_LO : 0;
+        }
+    }
+    if (op.width != 0) {
+        if (op.store) {
+            out.WriteDest = res;
+            res = rt_data;
+            out.MemWrite = true;
+        } else {
+            out.MemRead = true;
+        }
+    }
+    // nop and jr leave the previous result in place
+    if (op.type == 'I' || op.writes) out.ALU_Result = res;
+    return err;
+}
+
+template <class Trace>
+template <size_t O>
+uint32_t Simulator<Trace>::memOp(const IR::Decoded&) {
+    constexpr IR::OpInfo op = IR::Ops[O];
+    if (op.width == 0) return 0;
+    const EXMEM_Buffer& in = EX_MEM[cur_];
+    if (op.store) {
+        if (!in.MemWrite) return 0;
+        const uint32_t addr = in.WriteDest, data = in.ALU_Result,
+            err = checkAccess(mem, addr, op.width);
+        if (err) return err;
+        switch (op.width) {
+            case 4: { mem.saveWord(addr, data); break; }
+            case 2: { mem.saveHalfWord(addr, data); break; }
+            case 1: { mem.saveByte(addr, data); break; }
+        }
+        return 0;
+    }
+    if (!in.MemRead) return 0;
+    const uint32_t addr = in.ALU_Result, err = checkAccess(mem, addr, op.width);
+    if (err) return err;
+    switch (op.width) {
+        case 4: { MEM_WB[cur_ ^ 1].rt_data = mem.loadWord(addr); break; }
+        case 2: {
+            const uint32_t v = mem.loadHalfWord(addr);
+            MEM_WB[cur_ ^ 1].rt_data = op.sign ? SignExt16(v) : v & 0xffff;
+            break;
+        }
+        case 1: {
+            const uint32_t v = mem.loadByte(addr);
+            MEM_WB[cur_ ^ 1].rt_data = op.sign ? SignExt8(v) : v & 0xff;
+            break;
+        }
+    }
+    return 0;
+}
+
+template <class Trace>
+const typename Simulator<Trace>::Handlers Simulator<Trace>::handlers_ =
+    Simulator<Trace>::makeHandlers(std::make_index_sequence<IR::OP_COUNT>());
+
+/**
+* Functional engine
+* runs one instruction at a time with no hazards, timing or snapshot,
+* reusing the EX/MEM/WB semantics above
+*/
+
+template <class Trace>
+size_t Simulator<Trace>::fastForward(const size_t count, const uint64_t stopPC) {
+    size_t n = 0;
+    while (n < count && mem.getPC() != stopPC) {
+        const char type = mem.getDecoded(mem.getSlot()).type;
+        // HALT and illegal words are left to the pipeline
+        if (type == 'S' || type == 'F') break;
+        if (!execute()) break;
+        ++n;
+    }
+    // hand off with bubbles in every latch, as after a flush
+    IF_ID[0] = IF_ID[1] = IFID_Buffer();
+    ID_EX[0] = ID_EX[1] = IDEX_Buffer();
+    EX_MEM[0] = EX_MEM[1] = EXMEM_Buffer();
+    MEM_WB[0] = MEM_WB[1] = MEMWB_Buffer();
+    stall = flush = false;
+    return n;
+}
+
+template <class Trace>
+bool Simulator<Trace>::execute() {
+    const uint32_t PC = mem.getPC(), slot = mem.getSlot();
+    const IR::Decoded& d = mem.getDecoded(slot);
+    mem.setPC(PC + 4);
+    // ID, each stage then hands its latch on as step() does
+    IDEX_Buffer& id = ID_EX[cur_ ^ 1];
+    id.slot = slot;
+    id.rs_data = reg.getReg(d.rs);
+    id.rt_data = reg.getReg(d.rt);
+    id.jalPC = mem.getPC();
+    cur_ ^= 1;
+    // EX
+    EXMEM_Buffer& ex = EX_MEM[cur_ ^ 1];
+    ex.slot = slot;
+    ex.MemWrite = ex.MemRead = ex.RegWrite = false;
+    ex.isHILO = 0;
+    (this->*handlers_.ex[d.op])(d);
+    cur_ ^= 1;
+    // a halting access is not performed, the pipeline reports it
+    if (MEM() & HALT) {
+        mem.setPC(PC);
+        return false;
+    }
+    cur_ ^= 1;
+    WB();
+    // branch and jump targets
+    switch (d.op) {
+        case IR::OP_JR: { mem.setPC(id.rs_data); break; }
+        case IR::OP_J: case IR::OP_JAL: {
+            mem.setPC((mem.getPC() & 0xf0000000) | (d.C << 2));
+            break;
+        }
+        case IR::OP_BEQ: case IR::OP_BNE: case IR::OP_BGTZ: {
+            if ((d.op == IR::OP_BEQ && id.rs_data == id.rt_data) ||
+                (d.op == IR::OP_BNE && id.rs_data != id.rt_data) ||
+                (d.op == IR::OP_BGTZ && int32_t(id.rs_data) > 0))
+                mem.setPC(mem.getPC() + (d.imm << 2));
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+* Block cache
+* timing recorded from the pipeline per control state and replayed: the
+* instructions of a cached block run functionally as they pass ID, their
+* EX and WB errors are raised in the cycles the block recorded. Anything
+* the cache cannot replay exactly goes back to the pipeline
+*/
+
+template <class Trace>
+BlockKey Simulator<Trace>::controlState() const {
+    return {mem.getPC(), IF_ID[cur_].slot, ID_EX[cur_].slot, EX_MEM[cur_].slot, MEM_WB[cur_].slot};
+}
+
+// one block on the pipeline from the current state, kept unless HALT, an
+// illegal word or the end of the run comes up in it
+template <class Trace>
+void Simulator<Trace>::recordBlock() {
+    const BlockKey k = controlState();
+    const auto special = [this](const uint32_t slot) {
+        const char type = mem.getDecoded(slot).type;
+        return type == 'S' || type == 'F';
+    };
+    if (special(k.IF_ID) || special(k.ID_EX) || special(k.EX_MEM) || special(k.MEM_WB)) {
+        step();
+        return;
+    }
+    Block b;
+    const counters events = events_;
+    const size_t retired = retired_;
+    int taken = 0;
+    while (true) {
+        const size_t flushes = events_.branchFlushes;
+        if (!step()) return;
+        // EX wrote [cur_], WB read [cur_ ^ 1], ID passed on [cur_]
+        const uint32_t ex = EX_MEM[cur_].slot, id = ID_EX[cur_].slot;
+        b.cycles.push_back((ex != 0 ? BLOCK_EX : 0) | (MEM_WB[cur_ ^ 1].slot != 0 ? BLOCK_WB : 0));
+        b.ex += ex != 0;
+        if (id != 0) {
+            b.path.push_back(id);
+            b.jalPC.push_back(ID_EX[cur_].jalPC);
+        }
+        if (special(IF_ID[cur_].slot)) return;
+        const uint8_t op = mem.getDecoded(id).op;
+        if (op == IR::OP_BEQ || op == IR::OP_BNE || op == IR::OP_BGTZ) {
+            b.end = Block::END_BRANCH;
+            taken = events_.branchFlushes != flushes;
+            break;
+        }
+        if (op == IR::OP_JR) {
+            b.end = Block::END_JR;
+            taken = 1;
+            break;
+        }
+        if (b.cycles.size() == blockcache::kMaxCycles) break;
+    }
+    b.events = events_ - events;
+    if (taken && b.end == Block::END_BRANCH) --b.events.branchFlushes;
+    b.retired = retired_ - retired;
+    // the same state replays the same block, only its other outcome is new
+    bool fresh;
+    Block& e = blocks_.insert(k, fresh);
+    if (fresh) e = std::move(b);
+    e.next[taken] = controlState();
+    e.known[taken] = true;
+}
+
+// cached blocks from the current state for as long as they are known
+template <class Trace>
+void Simulator<Trace>::runBlocks() {
+    if (!enterBlocks()) return;
+    Block* b = blocks_.find(key_);
+    while (b != nullptr && cycle_ + b->cycles.size() <= limit_) {
+        const size_t first = flight_.size();
+        bool fault = false;
+        for (size_t i = 0; i < b->path.size(); ++i) {
+            flight_.emplace_back();
+            Flight& f = flight_.back();
+            if (exec(b->path[i], b->jalPC[i], f) & HALT) {
+                flight_.pop_back();
+                fault = true;
+                break;
+            }
+            if (f.exErr | f.wbErr) ++errs_;
+        }
+        int taken = 0;
+        uint32_t target = 0;
+        if (!fault && b->end != Block::END_LENGTH) {
+            const IR::Decoded& d = mem.getDecoded(b->path.back());
+            const uint32_t rs = reg.getReg(d.rs), rt = reg.getReg(d.rt);
+            target = rs;
+            taken = d.op == IR::OP_JR || (d.op == IR::OP_BEQ && rs == rt) ||
+                (d.op == IR::OP_BNE && rs != rt) || (d.op == IR::OP_BGTZ && int32_t(rs) > 0);
+        }
+        if (fault || !b->known[taken]) {
+            // the pipeline runs this block itself
+            while (flight_.size() > first) {
+                const Flight& f = flight_.back();
+                if (f.exErr | f.wbErr) --errs_;
+                undo(f, 1);
+                flight_.pop_back();
+            }
+            break;
+        }
+        charge(*b, taken && b->end == Block::END_BRANCH);
+        key_ = b->next[taken];
+        if (b->end == Block::END_JR) {
+            key_.PC = target;
+            b = blocks_.find(key_);
+        } else {
+            if (b->link[taken] == nullptr) b->link[taken] = blocks_.find(key_);
+            b = b->link[taken];
+        }
+        if (head_ >= 1024) {
+            flight_.erase(flight_.begin(), flight_.begin() + head_);
+            exNext_ -= head_;
+            head_ = 0;
+        }
+    }
+    leaveBlocks();
+}
+
+// the errors and events of b, its instructions already run
+template <class Trace>
+void Simulator<Trace>::charge(const Block& b, const bool taken) {
+    if (errs_ == 0 && err_ == 0) {
+        cycle_ += b.cycles.size();
+        head_ += b.retired;
+        exNext_ += b.ex;
+    } else {
+        for (const uint8_t c : b.cycles) {
+            dumpErrors();
+            uint32_t err = 0;
+            if (c & BLOCK_WB) {
+                const Flight& f = flight_[head_++];
+                err |= f.wbErr;
+                if (f.exErr | f.wbErr) --errs_;
+            }
+            if (c & BLOCK_EX) err |= flight_[exNext_++].exErr;
+            err_ = err;
+            ++cycle_;
+        }
+    }
+    events_ += b.events;
+    if (taken) ++events_.branchFlushes;
+    retired_ += b.retired;
+}
+
+// the pipeline at a block boundary handed to the cache: what its latches
+// hold runs to the end now and stays in flight
+template <class Trace>
+bool Simulator<Trace>::enterBlocks() {
+    const IFID_Buffer ifid[2] = {IF_ID[0], IF_ID[1]};
+    const IDEX_Buffer idex[2] = {ID_EX[0], ID_EX[1]};
+    const EXMEM_Buffer exmem[2] = {EX_MEM[0], EX_MEM[1]};
+    const MEMWB_Buffer memwb[2] = {MEM_WB[0], MEM_WB[1]};
+    const uint8_t cur = cur_;
+    key_ = controlState();
+    flight_.clear();
+    head_ = exNext_ = errs_ = 0;
+    Flight f = {};
+    const auto writeBack = [this](Flight& f, const MEMWB_Buffer& wb) {
+        f.rt_data = wb.rt_data;
+        f.RegWrite = wb.RegWrite;
+        f.WriteDest = wb.WriteDest;
+        f.wbErr = 0;
+        if (!wb.RegWrite) return;
+        if (wb.WriteDest == 0) {
+            f.wbErr = ERR_WRITE_REG_ZERO;
+        } else {
+            f.regOld = reg.getReg(wb.WriteDest);
+            reg.setReg(wb.WriteDest, wb.rt_data);
+        }
+    };
+    if (MEM_WB[cur_].slot != 0) {
+        f.slot = MEM_WB[cur_].slot;
+        writeBack(f, MEM_WB[cur_]);
+        flight_.push_back(f);
+    }
+    if (EX_MEM[cur_].slot != 0) {
+        const EXMEM_Buffer& in = EX_MEM[cur_];
+        f = {};
+        f.slot = in.slot;
+        f.ALU_Result = in.ALU_Result;
+        f.MemRead = in.MemRead;
+        f.MemWrite = in.MemWrite;
+        const uint32_t width = IR::Ops[mem.getDecoded(in.slot).op].width;
+        if (in.MemWrite && checkAccess(mem, in.WriteDest, width) == 0) {
+            f.memAddr = in.WriteDest;
+            f.memWidth = width;
+            f.memOld = width == 4 ? mem.loadWord(f.memAddr) :
+                width == 2 ? mem.loadHalfWord(f.memAddr) : mem.loadByte(f.memAddr);
+        }
+        if (MEM() & HALT) {
+            if (!flight_.empty()) undo(flight_[0], 3);
+            return false;
+        }
+        writeBack(f, MEM_WB[cur_ ^ 1]);
+        f.WriteDest = in.WriteDest;
+        flight_.push_back(f);
+    }
+    exNext_ = flight_.size();
+    if (ID_EX[cur_].slot != 0) {
+        f = {};
+        if (exec(ID_EX[cur_].slot, ID_EX[cur_].jalPC, f) & HALT) {
+            for (size_t i = flight_.size(); i-- > 0;) undo(flight_[i], 2 + (i == 0 && MEM_WB[cur].slot != 0));
+            for (int i = 0; i < 2; ++i) {
+                IF_ID[i] = ifid[i];
+                ID_EX[i] = idex[i];
+                EX_MEM[i] = exmem[i];
+                MEM_WB[i] = memwb[i];
+            }
+            cur_ = cur;
+            return false;
+        }
+        flight_.push_back(f);
+    }
+    for (const Flight& g : flight_) errs_ += (g.exErr | g.wbErr) != 0;
+    return true;
+}
+
+// the latches at key_ rebuilt from what is still in flight
+template <class Trace>
+void Simulator<Trace>::leaveBlocks() {
+    const Flight* at[3] = {}; // in MEM/WB, EX/MEM, ID/EX
+    const uint32_t slots[3] = {key_.MEM_WB, key_.EX_MEM, key_.ID_EX};
+    size_t i = head_;
+    for (int s = 0; s < 3; ++s) {
+        if (slots[s] != 0) at[s] = &flight_[i++];
+    }
+    // youngest first, each back to where its stage leaves it
+    if (at[2]) undo(*at[2], 1);
+    if (at[1]) undo(*at[1], 2);
+    if (at[0]) undo(*at[0], 3);
+    MEMWB_Buffer& wb = MEM_WB[cur_];
+    wb = MEMWB_Buffer();
+    wb.rt_data = wb.WriteDest = 0;
+    if (at[0]) {
+        wb.slot = at[0]->slot;
+        wb.rt_data = at[0]->rt_data;
+        wb.WriteDest = at[0]->WriteDest;
+        wb.RegWrite = at[0]->RegWrite;
+    }
+    MEM_WB[cur_ ^ 1] = wb;
+    MEM_WB[cur_ ^ 1].slot = 0;
+    MEM_WB[cur_ ^ 1].RegWrite = false;
+    EXMEM_Buffer& ex = EX_MEM[cur_];
+    ex = EXMEM_Buffer();
+    ex.ALU_Result = ex.WriteDest = 0;
+    if (at[1]) {
+        ex.slot = at[1]->slot;
+        ex.ALU_Result = at[1]->ALU_Result;
+        ex.WriteDest = at[1]->WriteDest;
+        ex.MemRead = at[1]->MemRead;
+        ex.MemWrite = at[1]->MemWrite;
+        ex.RegWrite = at[1]->RegWrite;
+    }
+    IDEX_Buffer& id = ID_EX[cur_];
+    id.slot = key_.ID_EX;
+    id.rs_data = id.rt_data = id.jalPC = 0;
+    if (at[2]) {
+        const IR::Decoded& d = mem.getDecoded(id.slot);
+        id.rs_data = reg.getReg(d.rs);
+        id.rt_data = reg.getReg(d.rt);
+        id.jalPC = at[2]->jalPC;
+    }
+    IF_ID[cur_].slot = key_.IF_ID;
+    mem.setPC(key_.PC);
+    stall = flush = false;
+    flight_.clear();
+    head_ = exNext_ = errs_ = 0;
+}
+
+// slot from ID to WB as execute() runs it, keeping its latch fields and
+// what it overwrote; a halting access changes nothing. jalPC: the fetch
+// PC ID saw it with
+template <class Trace>
+uint32_t Simulator<Trace>::exec(const uint32_t slot, const uint32_t jalPC, Flight& f) {
+    const IR::Decoded& d = mem.getDecoded(slot);
+    f.slot = slot;
+    f.jalPC = jalPC;
+    f.HI = reg.getHI();
+    f.LO = reg.getLO();
+    f.lock = reg.getHILOlock();
+    f.memWidth = 0;
+    IDEX_Buffer& id = ID_EX[cur_ ^ 1];
+    id.slot = slot;
+    id.rs_data = reg.getReg(d.rs);
+    id.rt_data = reg.getReg(d.rt);
+    id.jalPC = jalPC;
+    cur_ ^= 1;
+    EXMEM_Buffer& ex = EX_MEM[cur_ ^ 1];
+    ex.slot = slot;
+    ex.MemWrite = ex.MemRead = ex.RegWrite = false;
+    ex.isHILO = 0;
+    f.exErr = (this->*handlers_.ex[d.op])(d);
+    f.ALU_Result = ex.ALU_Result;
+    f.WriteDest = ex.WriteDest;
+    f.MemRead = ex.MemRead;
+    f.MemWrite = ex.MemWrite;
+    f.RegWrite = ex.RegWrite;
+    cur_ ^= 1;
+    if (ex.MemWrite) {
+        const uint32_t width = IR::Ops[d.op].width;
+        if (checkAccess(mem, ex.WriteDest, width) == 0) {
+            f.memAddr = ex.WriteDest;
+            f.memWidth = width;
+            f.memOld = width == 4 ? mem.loadWord(f.memAddr) :
+                width == 2 ? mem.loadHalfWord(f.memAddr) : mem.loadByte(f.memAddr);
+        }
+    }
+    const uint32_t err = MEM();
+    if (err & HALT) {
+        reg.restoreHILO(f.HI, f.LO, f.lock);
+        return err;
+    }
+    cur_ ^= 1;
+    const MEMWB_Buffer& wb = MEM_WB[cur_];
+    f.rt_data = wb.rt_data;
+    f.wbErr = 0;
+    if (wb.RegWrite) {
+        if (wb.WriteDest == 0) {
+            f.wbErr = ERR_WRITE_REG_ZERO;
+        } else {
+            f.regOld = reg.getReg(wb.WriteDest);
+            reg.setReg(wb.WriteDest, wb.rt_data);
+        }
+    }
+    return 0;
+}
+
+// f back to the top of the cycle in which stage holds it: 1 ID/EX undoes
+// all of it, 2 EX/MEM its store and WB, 3 MEM/WB its WB
+template <class Trace>
+void Simulator<Trace>::undo(const Flight& f, const int stage) {
+    if (f.RegWrite && f.WriteDest != 0) reg.setReg(f.WriteDest, f.regOld);
+    if (stage == 3) return;
+    switch (f.memWidth) {
+        case 4: { mem.saveWord(f.memAddr, f.memOld); break; }
+        case 2: { mem.saveHalfWord(f.memAddr, f.memOld); break; }
+        case 1: { mem.saveByte(f.memAddr, f.memOld); break; }
+    }
+    if (stage == 2) return;
+    reg.restoreHILO(f.HI, f.LO, f.lock);
+}
+
+/**
+* Checkpoint
+* the whole simulator state at the top of a cycle
+*/
+
+template <class Trace>
+void Simulator<Trace>::serialize(checkpoint& ckpt) {
+    ckpt.ioSize(cycle_);
+    ckpt.ioSize(retired_);
+    events_.serialize(ckpt);
+    ckpt.io(err_);
+    ckpt.ioSize(snapOff_);
+    ckpt.ioSize(errOff_);
+    mem.serialize(ckpt);
+    reg.serialize(ckpt);
+    IF_ID[cur_].serialize(ckpt);
+    ID_EX[cur_].serialize(ckpt);
+    EX_MEM[cur_].serialize(ckpt);
+    MEM_WB[cur_].serialize(ckpt);
+    MEM_WB[cur_ ^ 1].serialize(ckpt);
+    ckpt.io(stall);
+    ckpt.io(flush);
+}
+
+template <class Trace>
+bool Simulator<Trace>::saveCheckpoint(const char* path) {
+    // offsets must point at bytes that are on disk
+    tracer_.drain();
+    if (!snapshot.sync() || !error_dump.sync()) return false;
+    // without a per-cycle snapshot no offset is valid: a traced resume
+    // finds the file short and restarts it
+    snapOff_ = Trace::snapshot ? snapshot.tell() : SIZE_MAX;
+    errOff_ = error_dump.tell();
+    // write aside and rename so a crash keeps the previous checkpoint
+    const std::string tmp = std::string(path) + ".tmp";
+    checkpoint ckpt;
+    if (ckpt.openWrite(tmp.c_str())) serialize(ckpt);
+    if (!ckpt.close()) return false;
+    return rename(tmp.c_str(), path) == 0;
+}
+
+template <class Trace>
+bool Simulator<Trace>::resume(const char* path) {
+    checkpoint ckpt;
+    if (ckpt.openRead(path)) serialize(ckpt);
+    if (!ckpt.close()) return false;
+    status_ = RUNNING;
+    full_ = cycle_ == 0;
+    return true;
+}
+
+template class Simulator<TraceFull>;
+template class Simulator<TraceAsync>;
+template class Simulator<TraceErrorsOnly>;
+template class Simulator<TraceNone>;
@@ -0,0 +1,207 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include "memory.hpp"
+#include "regfile.hpp"
+#include "buffer.hpp"
+#include "irfile.hpp"
+#include "report.hpp"
+#include "checkpoint.hpp"
+#include "counters.hpp"
+#include "profile.hpp"
+#include "blockcache.hpp"
+#include "tracer.hpp"
+#include "errors.hpp"
+// fastForward without a stop PC
+#define FF_NO_PC (uint64_t(1) << 32)
+// 32-bit C sign extend to 64-bit
+#define SignExt32(C) (((C) >> 31 == 0x0) ?\
+    ((C) & 0x00000000ffffffff) : ((C) | 0xffffffff00000000))
+// 16-bit C sign extend to 32-bit
+#define SignExt16(C) (((C) >> 15 == 0x0) ? ((C) & 0x0000ffff) : ((C) | 0xffff0000))
+// 8-bit C sign extend to 32-bit
+#define SignExt8(C) (((C) >> 7 == 0x0) ? ((C) & 0x000000ff) : ((C) | 0xffffff00))
+// 16-bit C zero extend to 32-bit
+#define ZeroExt16(C) ((C) & 0x0000ffff)
+// check if a+b overflow
+#define isOverflow(a, b, c)\
+    (((int32_t(a) > 0 && int32_t(b) > 0 && int32_t(c) <= 0) ||\
+    (int32_t(a) < 0 && int32_t(b) < 0 && int32_t(c) >= 0)) ?\
+    ERR_NUMBER_OVERFLOW : 0)
+// check if a-b overflow
+#define isSubOverflow(a, b, c)\
+    (((int32_t(a) > 0 && int32_t(b) < 0 && int32_t(c) <= 0) ||\
+    (int32_t(a) < 0 && int32_t(b) > 0 && int32_t(c) >= 0)) ?\
+    ERR_NUMBER_OVERFLOW : 0)
+
+// size is 1, 2 or 4 bytes, naturally aligned
+inline uint32_t checkAccess(const memory& mem, const uint32_t addr, const uint32_t size) {
+    return (mem.inBounds(addr, size) ? 0 : ERR_ADDRESS_OVERFLOW) |
+        (addr & (size - 1) ? ERR_MISALIGNMENT : 0);
+}
+
+
+// tracing policies, fixed at compile time so disabled reports cost nothing
+// full: snapshot.rpt every cycle and error_dump.rpt
+struct TraceFull { static const bool snapshot = true, errors = true, async = false; };
+// as TraceFull, formatted and written on a writer thread
+struct TraceAsync { static const bool snapshot = true, errors = true, async = true; };
+// error_dump.rpt, and snapshot.rpt holds only the registers at close
+struct TraceErrorsOnly { static const bool snapshot = false, errors = true, async = false; };
+// no reports
+struct TraceNone { static const bool snapshot = false, errors = false, async = false; };
+
+// which cycles reach snapshot.rpt; every filter set must agree
+struct TraceFilter {
+    size_t from = 0, to = SIZE_MAX; // cycles, inclusive
+    uint64_t pcLo = 0, pcHi = uint64_t(1) << 32; // PC at the top of the cycle, [pcLo, pcHi)
+    // watchpoints: a write to a watched register or data byte opens a window
+    // of that cycle and the next `window`
+    uint32_t regs = 0; // register mask, $0 never written
+    uint64_t addrLo = 0, addrHi = 0; // data bytes [addrLo, addrHi)
+    size_t window = 16;
+    bool active() const {
+        return from != 0 || to != SIZE_MAX || pcLo != 0 || pcHi != uint64_t(1) << 32 || watching();
+    }
+    bool watching() const { return regs != 0 || addrLo < addrHi; }
+};
+
+class SimulatorBase {
+public:
+    enum Status {
+        RUNNING,
+        HALTED, // HALT reached every stage
+        ERROR, // address overflow or misalignment
+        ILLEGAL, // illegal instruction in ID
+        LIMIT // cycle limit reached
+    };
+};
+
+// cycle-accurate five-stage pipeline with its own state, so several can
+// live in one process; instantiated for the four policies above
+template <class Trace>
+class Simulator : public SimulatorBase {
+public:
+    // instruction and data memory in bytes, before the images are loaded
+    bool setMemorySize(const uint64_t isize, const uint64_t dsize) { return mem.resize(isize, dsize); }
+    // images in the iimage.bin/dimage.bin format
+    bool loadImages(const char* iimage = "iimage.bin", const char* dimage = "dimage.bin");
+    // images already in memory: PC0 and words, $sp and words
+    void loadImages(const uint32_t, const uint32_t*, const size_t,
+        const uint32_t, const uint32_t*, const size_t);
+    // without reports the pipeline runs untraced
+    bool openReports(const char* snapshot = "snapshot.rpt",
+        const char* error_dump = "error_dump.rpt", const bool direct = false);
+    // false if a report could not be written in full, errno set
+    bool closeReports();
+    // snapshot.rpt as a binary trace (tracefile.hpp), set before openReports
+    void setBinaryTrace(const bool rhs) { binary_ = rhs; }
+    // functional engine: run up to count instructions or until PC == stopPC,
+    // then hand off to the pipeline with empty latches
+    size_t fastForward(const size_t, const uint64_t stopPC = FF_NO_PC);
+    // one cycle, false once the run has ended
+    bool step();
+    // to the end; with the block cache on, untraced runs replay cached
+    // timing for blocks seen before
+    Status run();
+    // needs a policy without a per-cycle snapshot and no profile, ignored otherwise
+    void setBlockCache(const bool rhs) { cached_ = rhs; }
+    const size_t getBlockCount() const { return blocks_.size(); }
+    bool saveCheckpoint(const char*);
+    // restore a checkpoint, reports opened afterwards continue from it
+    bool resume(const char*);
+    void setCycleLimit(const size_t rhs) { limit_ = rhs; }
+    const size_t getCycle() const { return cycle_; }
+    // instructions through WB, bubbles and HALT excluded, plus fast-forwarded ones
+    const size_t getRetired() const { return retired_; }
+    const counters& getCounters() const { return events_; }
+    // per-PC profile from the next cycle on, after the images are loaded
+    void enableProfile() { prof_.reset(mem.getInstrCount()); }
+    void printProfile(FILE* f, const size_t top) const { prof_.print(f, mem, top); }
+    void printFoldedProfile(FILE* f) const { prof_.printFolded(f, mem); }
+    const Status getStatus() const { return status_; }
+    const regfile& getRegfile() const { return reg; }
+    const memory& getMemory() const { return mem; }
+    // the reports were missing or short on resume and restart here
+    const bool reportsRestarted() const { return full_ && cycle_ != 0; }
+    // cycles left out skip all formatting, the next one printed is a full block
+    void setTraceFilter(const TraceFilter& rhs) {
+        filter_ = rhs;
+        filtered_ = filter_.active();
+        if (filtered_) full_ = true;
+    }
+
+private:
+    void traceRegs(const bool);
+    uint32_t WB();
+    uint32_t MEM();
+    uint32_t EX();
+    uint32_t ID();
+    uint32_t IF();
+    // EX and MEM work of one Op, indexed by IR::Decoded::op
+    template <size_t O> uint32_t exOp(const IR::Decoded&);
+    template <size_t O> uint32_t memOp(const IR::Decoded&);
+    typedef uint32_t (Simulator::*Handler)(const IR::Decoded&);
+    struct Handlers { Handler ex[IR::OP_COUNT], mem[IR::OP_COUNT]; };
+    template <size_t... O>
+    static constexpr Handlers makeHandlers(std::index_sequence<O...>) {
+        return {{&Simulator::exOp<O>...}, {&Simulator::memOp<O>...}};
+    }
+    static const Handlers handlers_;
+    bool execute();
+    void dumpErrors();
+    // block cache: the instructions the pipeline would still hold, run
+    // ahead functionally with what they overwrote
+    struct Flight {
+        uint32_t slot, ALU_Result, WriteDest, rt_data; // EX/MEM and MEM/WB fields
+        uint32_t jalPC; // ID/EX field
+        bool MemRead, MemWrite, RegWrite, lock;
+        uint32_t exErr, wbErr; // raised in EX, in WB
+        uint32_t regOld, memAddr, memOld, memWidth, HI, LO;
+    };
+    BlockKey controlState() const;
+    void recordBlock();
+    void runBlocks();
+    bool enterBlocks();
+    void leaveBlocks();
+    uint32_t exec(const uint32_t, const uint32_t, Flight&);
+    void undo(const Flight&, const int);
+    void charge(const Block&, const bool);
+    bool halted() const;
+    bool traced();
+    void serialize(checkpoint&);
+
+    memory mem;
+    regfile reg;
+    // double-buffered latches: [cur_] is the state at the top of the cycle,
+    // read by the stage after it; [cur_ ^ 1] is written during the cycle
+    IFID_Buffer IF_ID[2];
+    IDEX_Buffer ID_EX[2];
+    EXMEM_Buffer EX_MEM[2];
+    MEMWB_Buffer MEM_WB[2];
+    uint8_t cur_ = 0;
+    report snapshot, error_dump;
+    tracer tracer_{snapshot, error_dump};
+    TraceRecord rec_; // the cycle being traced, stage labels filled as it runs
+    bool stall = false;
+    bool flush = false;
+    size_t cycle_ = 0, limit_ = 500000, snapOff_ = 0, errOff_ = 0;
+    size_t retired_ = 0;
+    counters events_;
+    profile prof_;
+    uint32_t err_ = 0; // raised in the previous cycle, dumped at the top of this one
+    Status status_ = RUNNING;
+    bool full_ = true; // print every register at the next cycle
+    bool binary_ = false;
+    TraceFilter filter_;
+    bool filtered_ = false;
+    size_t watchEnd_ = 0; // cycles below it are in a watch window
+    bool cached_ = false;
+    blockcache blocks_;
+    BlockKey key_; // the state the next block starts in
+    std::vector<Flight> flight_; // [head_, end) in flight, [exNext_, end) not through EX
+    size_t head_ = 0, exNext_ = 0, errs_ = 0; // errs_: in flight with an error to raise
+};
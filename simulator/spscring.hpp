@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+// single-producer/single-consumer ring of fixed-size records, lock-free;
+// a full ring blocks the producer, which bounds how far it runs ahead
+template <class T, size_t N>
+class spscring {
+    static_assert((N & (N - 1)) == 0, "spscring size must be a power of two");
+public:
+    // the slots are cache-line aligned, which plain new does not promise before C++17
+    static void* operator new(const size_t n) {
+        void* p = nullptr;
+        if (posix_memalign(&p, 64, n) != 0) throw std::bad_alloc();
+        return p;
+    }
+    static void operator delete(void* p) { free(p); }
+    void push(const T& v) {
+        const size_t h = head_.load(std::memory_order_relaxed);
+        while (h - tail_.load(std::memory_order_acquire) == N) std::this_thread::yield();
+        buf_[h & (N - 1)] = v;
+        head_.store(h + 1, std::memory_order_release);
+    }
+    // hand up to max records to f in order, then free their slots
+    template <class F>
+    size_t consume(F&& f, const size_t max = N) {
+        const size_t t = tail_.load(std::memory_order_relaxed);
+        size_t h = head_.load(std::memory_order_acquire);
+        if (h - t > max) h = t + max;
+        for (size_t i = t; i != h; ++i) f(buf_[i & (N - 1)]);
+        tail_.store(h, std::memory_order_release);
+        return h - t;
+    }
+    // everything pushed has been consumed
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) T buf_[N];
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of workers, each with its own deque: a worker pops its own
+// newest task and steals the oldest task of another worker when idle
+class threadpool {
+public:
+    typedef std::function<void()> task;
+    explicit threadpool(size_t n) : queues_(n == 0 ? 1 : n) {}
+    // queue a task before run(), spread round-robin over the workers
+    void submit(task t) {
+        queues_[next_++ % queues_.size()].tasks.push_back(std::move(t));
+    }
+    // run every queued task and wait for all of them
+    void run() {
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < queues_.size(); ++i) {
+            workers.emplace_back([this, i] { work(i); });
+        }
+        for (auto& w : workers) w.join();
+    }
+    const size_t size() const { return queues_.size(); }
+
+private:
+    struct queue {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+    bool pop(const size_t i, task& t) {
+        queue& q = queues_[i];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.tasks.empty()) return false;
+        t = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+    bool steal(const size_t i, task& t) {
+        for (size_t k = 1; k < queues_.size(); ++k) {
+            queue& q = queues_[(i + k) % queues_.size()];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.tasks.empty()) continue;
+            t = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+    // tasks never spawn tasks, so an empty sweep means the pool is drained
+    void work(const size_t i) {
+        task t;
+        while (pop(i, t) || steal(i, t)) t();
+    }
+    std::vector<queue> queues_;
+    size_t next_ = 0;
+};
@@ -0,0 +1,69 @@
+#include "tracefile.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// pipeline-trace: a binary snapshot.trc printed as the snapshot.rpt text it
+// stands for, whole or a range of cycles found through its index
+
+namespace {
+    int usage(const char* argv0) {
+        fprintf(stderr, "usage: %s [--cycles from:to] [-o file] snapshot.trc\n"
+            "  the range is inclusive, either end may be left out; without it the\n"
+            "  whole trace is converted. Output goes to stdout unless -o is given\n", argv0);
+        return 2;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t from = 0, to = SIZE_MAX;
+    const char* out = "/dev/stdout";
+    const char* in = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--cycles" && i + 1 < argc) {
+            const char* range = argv[++i];
+            const char* colon = strchr(range, ':');
+            if (colon == nullptr) return usage(argv[0]);
+            char* end;
+            if (colon != range) {
+                from = strtoull(range, &end, 0);
+                if (end != colon) return usage(argv[0]);
+            }
+            if (colon[1] != '\0') {
+                to = strtoull(colon + 1, &end, 0);
+                if (*end != '\0') return usage(argv[0]);
+            }
+            if (from > to) return usage(argv[0]);
+        } else if (arg == "-o" && i + 1 < argc) {
+            out = argv[++i];
+        } else if (in == nullptr && arg[0] != '-') {
+            in = argv[i];
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (in == nullptr) return usage(argv[0]);
+    tracereader trace;
+    if (!trace.open(in)) {
+        fprintf(stderr, "pipeline-trace: %s is not a binary trace\n", in);
+        return 1;
+    }
+    report text, none;
+    if (!text.open(out)) {
+        perror(out);
+        return 1;
+    }
+    tracer t(text, none);
+    const bool ok = trace.replay(t, from, to);
+    if (!text.close()) {
+        perror(out);
+        return 1;
+    }
+    if (!ok) {
+        fprintf(stderr, "pipeline-trace: %s is cut short or damaged\n", in);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,311 @@
+#include "tracefile.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const uint32_t kVersion = 1;
+    const size_t kHeader = 8, kFooter = 20;
+
+    size_t putVar(uint8_t* p, size_t n, uint64_t v) {
+        for (; v >= 0x80; v >>= 7) p[n++] = uint8_t(v) | 0x80;
+        p[n++] = uint8_t(v);
+        return n;
+    }
+
+    uint64_t zigzag(const int64_t v) { return uint64_t(v) << 1 ^ uint64_t(v >> 63); }
+    int64_t unzigzag(const uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+    void putLE(report& out, uint64_t v, const int bytes) {
+        for (int i = 0; i < bytes; ++i, v >>= 8) out.put(char(v & 0xff));
+    }
+
+    uint64_t getLE(const uint8_t* p, const int bytes) {
+        uint64_t v = 0;
+        for (int i = bytes; i-- > 0;) v = v << 8 | p[i];
+        return v;
+    }
+
+    // rs and rt only count where the note prints them
+    StageLabel canonical(StageLabel s) {
+        if (!(s.note & (NOTE_FWD_EXDM_RS | NOTE_FWD_DMWB_RS))) s.rs = 0;
+        if (!(s.note & (NOTE_FWD_EXDM_RT | NOTE_FWD_DMWB_RT))) s.rt = 0;
+        return s;
+    }
+
+    bool same(const StageLabel& a, const StageLabel& b) {
+        return a.op == b.op && a.note == b.note && a.rs == b.rs && a.rt == b.rt;
+    }
+
+    // bounds-checked reads, ok cleared at the first one past the end
+    struct cursor {
+        uint8_t byte() {
+            if (p == end) {
+                ok = false;
+                return 0;
+            }
+            return *p++;
+        }
+        uint64_t var() {
+            uint64_t v = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                const uint8_t b = byte();
+                v |= uint64_t(b & 0x7f) << shift;
+                if (!(b & 0x80)) return v;
+            }
+            ok = false;
+            return 0;
+        }
+        const uint8_t *p, *end;
+        bool ok;
+    };
+
+    bool decode(cursor& c, tracestate& s, TraceRecord& r) {
+        const uint8_t flags = c.byte();
+        r.kind = flags & TRC_HEAD ? TraceRecord::HEAD : TraceRecord::CYCLE;
+        r.cycle = s.cycle;
+        if (flags & TRC_CYCLE) r.cycle += unzigzag(c.var());
+        r.c.PC = s.PC;
+        if (flags & TRC_PC) r.c.PC += uint32_t(unzigzag(c.var()));
+        r.full = flags & TRC_FULL;
+        r.dest = 0;
+        r.hilo = 0;
+        if (r.full) {
+            const uint64_t mask = c.var();
+            if (mask >> 34) return false;
+            for (int i = 0; i < 34; ++i) {
+                if (mask >> i & 1) s.regs[i] = uint32_t(c.var());
+            }
+        } else {
+            if (flags & TRC_DEST) {
+                r.dest = c.byte();
+                if (r.dest == 0 || r.dest > 31) return false;
+                r.c.value = s.regs[r.dest] = uint32_t(c.var());
+            }
+            if (flags & TRC_HI) {
+                r.hilo |= 0x01;
+                r.c.HI = s.regs[32] = uint32_t(c.var());
+            }
+            if (flags & TRC_LO) {
+                r.hilo |= 0x10;
+                r.c.LO = s.regs[33] = uint32_t(c.var());
+            }
+        }
+        if (!(flags & TRC_HEAD)) {
+            tracestate::Seen& seen = s.seen[(r.c.PC >> 2) & (tracestate::kCache - 1)];
+            if (flags & TRC_INSTR) {
+                uint8_t w[4];
+                for (uint8_t& b : w) b = c.byte();
+                seen = {r.c.PC, uint32_t(getLE(w, 4)), true};
+            } else if (!seen.known || seen.PC != r.c.PC) {
+                return false;
+            }
+            r.c.instr = seen.instr;
+            uint32_t codes = c.byte();
+            codes |= c.byte() << 8;
+            for (int k = 0; k < 5; ++k) {
+                StageLabel& l = r.stages[k];
+                switch (codes >> 2 * k & 3) {
+                    case STAGE_SHIFTED: {
+                        if (k == 0) return false;
+                        l = s.stages[k - 1];
+                        break;
+                    }
+                    case STAGE_SAME: { l = s.stages[k]; break; }
+                    case STAGE_OP: { l = StageLabel(c.byte()); break; }
+                    case STAGE_FULL: {
+                        l = StageLabel(c.byte());
+                        l.note = c.byte();
+                        l.rs = c.byte();
+                        l.rt = c.byte();
+                        break;
+                    }
+                }
+                if (l.op >= IR::OP_COUNT) return false;
+            }
+            std::copy(r.stages, r.stages + 5, s.stages);
+        }
+        s.cycle = r.cycle + 1;
+        s.PC = r.c.PC + 4;
+        return c.ok;
+    }
+}
+
+void tracestate::reset() {
+    cycle = 0;
+    PC = 0;
+    std::fill(regs, regs + 34, 0);
+    std::fill(stages, stages + 5, StageLabel());
+    std::fill(seen, seen + kCache, Seen());
+}
+
+/**
+* Writer
+*/
+
+void tracewriter::begin() {
+    if (begun_) return;
+    out_.put("PTRC", 4);
+    putLE(out_, kVersion, 4);
+    begun_ = true;
+}
+
+void tracewriter::put(const TraceRecord& r, const uint32_t (&regs)[34]) {
+    begin();
+    if (records_ == kBlock) {
+        index_.push_back(r.cycle);
+        index_.push_back(out_.tell());
+        s_.reset();
+        records_ = 0;
+    }
+    ++records_;
+    // flags, cycle, PC, mask and registers, IF word, codes, labels
+    uint8_t buf[256];
+    uint8_t flags = r.kind == TraceRecord::HEAD ? TRC_HEAD : 0;
+    size_t n = 1;
+    if (r.cycle != s_.cycle) {
+        flags |= TRC_CYCLE;
+        n = putVar(buf, n, zigzag(int64_t(r.cycle - s_.cycle)));
+    }
+    if (r.c.PC != s_.PC) {
+        flags |= TRC_PC;
+        n = putVar(buf, n, zigzag(int32_t(r.c.PC - s_.PC)));
+    }
+    if (r.full) {
+        flags |= TRC_FULL;
+        uint64_t mask = 0;
+        for (int i = 0; i < 34; ++i) mask |= uint64_t(regs[i] != s_.regs[i]) << i;
+        n = putVar(buf, n, mask);
+        for (int i = 0; i < 34; ++i) {
+            if (mask >> i & 1) n = putVar(buf, n, s_.regs[i] = regs[i]);
+        }
+    } else {
+        if (r.dest != 0) {
+            flags |= TRC_DEST;
+            buf[n++] = r.dest;
+            n = putVar(buf, n, s_.regs[r.dest] = r.c.value);
+        }
+        if (r.hilo & 0x01) {
+            flags |= TRC_HI;
+            n = putVar(buf, n, s_.regs[32] = r.c.HI);
+        }
+        if (r.hilo & 0x10) {
+            flags |= TRC_LO;
+            n = putVar(buf, n, s_.regs[33] = r.c.LO);
+        }
+    }
+    if (r.kind != TraceRecord::HEAD) {
+        tracestate::Seen& seen = s_.seen[(r.c.PC >> 2) & (tracestate::kCache - 1)];
+        if (!seen.known || seen.PC != r.c.PC || seen.instr != r.c.instr) {
+            flags |= TRC_INSTR;
+            for (int i = 0; i < 4; ++i) buf[n++] = uint8_t(r.c.instr >> 8 * i);
+            seen = {r.c.PC, r.c.instr, true};
+        }
+        const size_t at = n;
+        n += 2;
+        uint32_t codes = 0;
+        StageLabel next[5];
+        for (int k = 0; k < 5; ++k) {
+            const StageLabel l = next[k] = canonical(r.stages[k]);
+            if (k > 0 && same(l, s_.stages[k - 1])) {
+                codes |= STAGE_SHIFTED << 2 * k;
+            } else if (same(l, s_.stages[k])) {
+                codes |= STAGE_SAME << 2 * k;
+            } else if (l.note == 0) {
+                codes |= STAGE_OP << 2 * k;
+                buf[n++] = l.op;
+            } else {
+                codes |= STAGE_FULL << 2 * k;
+                buf[n++] = l.op;
+                buf[n++] = l.note;
+                buf[n++] = l.rs;
+                buf[n++] = l.rt;
+            }
+        }
+        buf[at] = uint8_t(codes);
+        buf[at + 1] = uint8_t(codes >> 8);
+        std::copy(next, next + 5, s_.stages);
+    }
+    buf[0] = flags;
+    s_.cycle = r.cycle + 1;
+    s_.PC = r.c.PC + 4;
+    out_.put(reinterpret_cast<const char*>(buf), n);
+}
+
+void tracewriter::finish() {
+    begin();
+    const uint64_t at = out_.tell();
+    for (const uint64_t v : index_) putLE(out_, v, 8);
+    putLE(out_, at, 8);
+    putLE(out_, index_.size() / 2, 8);
+    out_.put("PTRX", 4);
+}
+
+/**
+* Reader
+*/
+
+tracereader::~tracereader() {
+    if (data_ != nullptr) munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+bool tracereader::open(const char* path) {
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < kHeader + kFooter) {
+        ::close(fd);
+        return false;
+    }
+    size_ = st.st_size;
+    void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    data_ = static_cast<const uint8_t*>(p);
+    const uint8_t* footer = data_ + size_ - kFooter;
+    end_ = getLE(footer, 8);
+    const uint64_t blocks = getLE(footer + 8, 8);
+    if (memcmp(data_, "PTRC", 4) != 0 || getLE(data_ + 4, 4) != kVersion ||
+        memcmp(footer + 16, "PTRX", 4) != 0 || end_ < kHeader || end_ > size_ - kFooter ||
+        (size_ - kFooter - end_) / 16 != blocks || (size_ - kFooter - end_) % 16 != 0) return false;
+    index_.resize(2 * blocks);
+    for (size_t i = 0; i < index_.size(); ++i) index_[i] = getLE(data_ + end_ + 8 * i, 8);
+    // blocks in file and cycle order
+    for (size_t b = 0; b < blocks; ++b) {
+        const uint64_t start = b == 0 ? kHeader : index_[2 * b - 1];
+        if (index_[2 * b + 1] < start || index_[2 * b + 1] > end_) return false;
+        if (b > 0 && index_[2 * b] < index_[2 * b - 2]) return false;
+    }
+    return true;
+}
+
+bool tracereader::replay(tracer& t, const size_t from, const size_t to) const {
+    const size_t blocks = getBlockCount();
+    // the last block that starts at or before from
+    size_t b = 0;
+    for (size_t lo = 1, hi = blocks; lo < hi;) {
+        const size_t mid = (lo + hi) / 2;
+        if (index_[2 * mid] <= from) {
+            b = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    tracestate s;
+    for (; b < blocks; ++b) {
+        s.reset();
+        cursor c = {data_ + index_[2 * b + 1], data_ + (b + 1 < blocks ? index_[2 * b + 3] : end_), true};
+        while (c.p != c.end) {
+            TraceRecord r;
+            if (!decode(c, s, r)) return false;
+            if (r.cycle > to) return true;
+            if (r.cycle < from) continue;
+            if (r.full) t.putRegs(s.regs, r.cycle);
+            t.put(r);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <vector>
+#include "tracer.hpp"
+
+// snapshot.trc: the records behind snapshot.rpt, each coded against what
+// the cycle before predicts, in blocks that decode on their own and an
+// index of the first cycle and offset of every block
+//   "PTRC" version | blocks | (cycle, offset) per block | index offset, blocks, "PTRX"
+// all little-endian; a record is its flags, then only what they name
+#define TRC_HEAD 0x01 // no stage lines
+#define TRC_FULL 0x02 // every register, those that changed in the block follow
+#define TRC_CYCLE 0x04 // not the cycle after the previous record
+#define TRC_PC 0x08 // not 4 past the previous PC
+#define TRC_INSTR 0x10 // IF word not the one last seen at this PC
+#define TRC_DEST 0x20 // a register line
+#define TRC_HI 0x40 // a $HI line
+#define TRC_LO 0x80 // a $LO line
+// per stage, two bits of the code after the flags
+#define STAGE_SHIFTED 0 // the label of the stage before it in the previous record
+#define STAGE_SAME 1 // its own label in the previous record
+#define STAGE_OP 2 // an op without a note
+#define STAGE_FULL 3 // op, note, rs, rt
+
+// what the next record is coded against, the same on both sides
+struct tracestate {
+    static const size_t kCache = 1024;
+    void reset();
+    size_t cycle;
+    uint32_t PC;
+    uint32_t regs[34]; // as last printed
+    StageLabel stages[5];
+    struct Seen {
+        uint32_t PC = 0, instr = 0;
+        bool known = false;
+    };
+    Seen seen[kCache]; // the IF word last fetched, by PC
+};
+
+// encodes into snapshot.rpt's report in place of the text
+class tracewriter {
+public:
+    static const size_t kBlock = 4096; // records
+    explicit tracewriter(report& out) : out_(out) {}
+    // regs: the registers of a full record
+    void put(const TraceRecord&, const uint32_t (&regs)[34]);
+    // the index, once every record is in
+    void finish();
+
+private:
+    void begin();
+    report& out_;
+    tracestate s_;
+    std::vector<uint64_t> index_; // cycle, offset per block
+    size_t records_ = kBlock; // in the current block
+    bool begun_ = false;
+};
+
+// reads snapshot.trc back into TraceRecords
+class tracereader {
+public:
+    tracereader() {}
+    tracereader(const tracereader&) = delete;
+    tracereader& operator=(const tracereader&) = delete;
+    ~tracereader();
+    bool open(const char*);
+    const size_t getBlockCount() const { return index_.size() / 2; }
+    const size_t getSize() const { return size_; }
+    // the records of cycles [from, to] to t in order; false if the file is
+    // cut short or malformed
+    bool replay(tracer& t, const size_t from, const size_t to) const;
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0, end_ = 0; // end_: where the blocks end
+    std::vector<uint64_t> index_;
+};
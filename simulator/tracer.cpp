@@ -0,0 +1,170 @@
+#include "tracer.hpp"
+#include <chrono>
+#include "errors.hpp"
+#include "tracefile.hpp"
+
+tracer::tracer(report& snapshot, report& error_dump) : snapshot_(snapshot), error_dump_(error_dump) {}
+
+tracer::~tracer() {
+    stop();
+    finish();
+}
+
+void tracer::putRegs(const uint32_t (&regs)[34], const size_t cycle) {
+    TraceRecord r;
+    r.kind = TraceRecord::REGS;
+    r.cycle = cycle;
+    for (uint8_t i = 0; i < 34; i += 5) {
+        r.dest = i;
+        for (int k = 0; k < 5 && i + k < 34; ++k) r.regs[k] = regs[i + k];
+        put(r);
+    }
+}
+
+void tracer::start() {
+    // with a single core the writer only takes turns with the simulation
+    if (async_ || std::thread::hardware_concurrency() == 1) return;
+    ring_.reset(new ring);
+    stop_.store(false);
+    async_ = true;
+    writer_ = std::thread([this] { work(); });
+}
+
+void tracer::drain() {
+    if (!async_) return;
+    while (!ring_->empty()) std::this_thread::yield();
+}
+
+void tracer::stop() {
+    if (!async_) return;
+    stop_.store(true, std::memory_order_release);
+    writer_.join();
+    async_ = false;
+    ring_.reset();
+}
+
+void tracer::setBinary() {
+    if (!binary_) binary_.reset(new tracewriter(snapshot_));
+}
+
+void tracer::finish() {
+    if (!binary_ || !snapshot_.isOpen()) return;
+    binary_->finish();
+    binary_.reset();
+}
+
+void tracer::work() {
+    for (;;) {
+        // free slots in batches so a full ring unblocks the simulation early
+        if (ring_->consume([this](const TraceRecord& r) { write(r); }, 256) != 0) continue;
+        if (stop_.load(std::memory_order_acquire)) {
+            if (ring_->empty()) return;
+            continue;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+}
+
+void tracer::write(const TraceRecord& r) {
+    static const struct { uint32_t bit; const char* msg; } errors[] = {
+        {ERR_WRITE_REG_ZERO, ": Write $0 Error\n"},
+        {ERR_ADDRESS_OVERFLOW, ": Address Overflow\n"},
+        {ERR_MISALIGNMENT, ": Misalignment Error\n"},
+        {ERR_OVERWRTIE_REG_HI_LO, ": Overwrite HI-LO registers\n"},
+        {ERR_NUMBER_OVERFLOW, ": Number Overflow\n"}
+    };
+    switch (r.kind) {
+        case TraceRecord::REGS: {
+            for (int k = 0; k < 5 && r.dest + k < 34; ++k) regs_[r.dest + k] = r.regs[k];
+            return;
+        }
+        case TraceRecord::ERRORS: {
+            for (const auto& e : errors) {
+                if (r.err & e.bit) {
+                    error_dump_.put("In cycle ", 9);
+                    error_dump_.putDec(r.cycle);
+                    error_dump_.put(e.msg);
+                }
+            }
+            return;
+        }
+    }
+    if (binary_) {
+        binary_->put(r, regs_);
+        return;
+    }
+    snapshot_.put("cycle ", 6);
+    snapshot_.putDec(r.cycle);
+    snapshot_.put('\n');
+    if (r.full) {
+        for (int i = 0; i < 32; ++i) {
+            snapshot_.put('$');
+            snapshot_.putDec(i, 2);
+            snapshot_.put(": 0x", 4);
+            snapshot_.putHex(regs_[i]);
+            snapshot_.put('\n');
+        }
+        snapshot_.put("$HI: 0x", 7);
+        snapshot_.putHex(regs_[32]);
+        snapshot_.put("\n$LO: 0x", 8);
+        snapshot_.putHex(regs_[33]);
+        snapshot_.put('\n');
+    } else {
+        if (r.dest != 0) {
+            snapshot_.put('$');
+            snapshot_.putDec(r.dest, 2);
+            snapshot_.put(": 0x", 4);
+            snapshot_.putHex(r.c.value);
+            snapshot_.put('\n');
+        }
+        if (r.hilo & 0x01) {
+            snapshot_.put("$HI: 0x", 7);
+            snapshot_.putHex(r.c.HI);
+            snapshot_.put('\n');
+        }
+        if (r.hilo & 0x10) {
+            snapshot_.put("$LO: 0x", 7);
+            snapshot_.putHex(r.c.LO);
+            snapshot_.put('\n');
+        }
+    }
+    snapshot_.put("PC: 0x", 6);
+    snapshot_.putHex(r.c.PC);
+    snapshot_.put('\n');
+    if (r.kind == TraceRecord::HEAD) return;
+    snapshot_.put("IF: 0x", 6);
+    snapshot_.putHex(r.c.instr);
+    label(r.stages[0]);
+    snapshot_.put("\nID: ", 5);
+    label(r.stages[1]);
+    snapshot_.put("\nEX: ", 5);
+    label(r.stages[2]);
+    snapshot_.put("\nDM: ", 5);
+    label(r.stages[3]);
+    snapshot_.put("\nWB: ", 5);
+    label(r.stages[4]);
+    snapshot_.put("\n\n\n", 3);
+}
+
+void tracer::label(const StageLabel& s) {
+    snapshot_.put(IR::Ops[s.op].name);
+    if (s.note == 0) return;
+    if (s.note & NOTE_STALLED) snapshot_.put(" to_be_stalled", 14);
+    if (s.note & NOTE_FLUSHED) snapshot_.put(" to_be_flushed", 14);
+    if (s.note & NOTE_FWD_EXDM_RS) {
+        snapshot_.put(" fwd_EX-DM_rs_$", 15);
+        snapshot_.putDec(s.rs);
+    }
+    if (s.note & NOTE_FWD_DMWB_RS) {
+        snapshot_.put(" fwd_DM-WB_rs_$", 15);
+        snapshot_.putDec(s.rs);
+    }
+    if (s.note & NOTE_FWD_EXDM_RT) {
+        snapshot_.put(" fwd_EX-DM_rt_$", 15);
+        snapshot_.putDec(s.rt);
+    }
+    if (s.note & NOTE_FWD_DMWB_RT) {
+        snapshot_.put(" fwd_DM-WB_rt_$", 15);
+        snapshot_.putDec(s.rt);
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "buffer.hpp"
+#include "report.hpp"
+#include "spscring.hpp"
+
+// one unit of report output: the simulation fills it, a tracer formats it
+struct TraceRecord {
+    enum Kind : uint8_t {
+        CYCLE, // a snapshot.rpt block
+        REGS, // five values of the register file for the next full block
+        HEAD, // a CYCLE block without its stage lines
+        ERRORS // the error_dump.rpt lines of a cycle
+    };
+    struct Delta { uint32_t value, HI, LO, PC, instr; };
+    size_t cycle;
+    union {
+        Delta c; // CYCLE
+        uint32_t regs[5]; // REGS
+        uint32_t err; // ERRORS
+    };
+    StageLabel stages[5]; // CYCLE
+    uint8_t kind;
+    bool full; // CYCLE: every register, sent ahead in REGS records
+    uint8_t dest; // CYCLE: register printed as changed, 0 for none; REGS: index of regs[0]
+    uint8_t hilo; // CYCLE: HI 0x01, LO 0x10 printed as changed
+};
+
+class tracewriter;
+
+// formats TraceRecords into the two reports, inline or on a writer thread
+class tracer {
+public:
+    tracer(report& snapshot, report& error_dump);
+    tracer(const tracer&) = delete;
+    tracer& operator=(const tracer&) = delete;
+    ~tracer();
+    void put(const TraceRecord& r) {
+        if (async_) ring_->push(r);
+        else write(r);
+    }
+    // register file: 32 registers, HI, LO
+    void putRegs(const uint32_t (&regs)[34], const size_t cycle);
+    // hand formatting to a writer thread until stop()
+    void start();
+    // wait until the writer has formatted everything put so far
+    void drain();
+    void stop();
+    // snapshot records go to the snapshot report as a binary trace, see
+    // tracefile.hpp; before start()
+    void setBinary();
+    // the binary trace's index, after stop()
+    void finish();
+
+private:
+    void write(const TraceRecord&);
+    void label(const StageLabel&);
+    void work();
+
+    report &snapshot_, &error_dump_;
+    uint32_t regs_[34] = {}; // collected from REGS records
+    // about 1 MiB of records between the simulation and the writer
+    typedef spscring<TraceRecord, 1 << 14> ring;
+    std::unique_ptr<ring> ring_;
+    std::unique_ptr<tracewriter> binary_;
+    std::thread writer_;
+    std::atomic<bool> stop_{false};
+    bool async_ = false;
+};